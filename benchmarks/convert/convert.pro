@@ -0,0 +1,14 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = app
+TARGET = tst_convert
+CONFIG += testcase console communi
+CONFIG -= app_bundle
+QT = core network testlib
+COMMUNI += core
+
+SOURCES += tst_convert.cpp
+
+include(../../quasselprotocol.pri)
@@ -0,0 +1,115 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselmessage.h"
+#include "quasseltypes.h"
+#include "bufferinfo.h"
+#include "message.h"
+#include <IrcConnection>
+#include <IrcMessage>
+#include <QtTest/QtTest>
+
+// Compares converting core messages with Quassel::convertMessage(), which
+// constructs the IRC messages directly, with building them from parameters
+// and letting IrcMessage::fromParameters() look the type up by command.
+
+class tst_Convert : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void direct();
+    void fromParameters();
+
+private:
+    IrcConnection connection;
+    QList<Message> messages;
+};
+
+void tst_Convert::initTestCase()
+{
+    Quassel::registerTypes();
+
+    BufferInfo channel(1, 1, BufferInfo::ChannelBuffer, 0, "#channel");
+    for (int i = 0; i < 10000; ++i) {
+        const QString sender = QString("nick%1!user@host").arg(i % 97);
+        switch (i % 10) {
+        case 0:
+            messages += Message(channel, Message::Join, QString(), sender);
+            break;
+        case 1:
+            messages += Message(channel, Message::Quit, "Quit: bye", sender);
+            break;
+        case 2:
+            messages += Message(channel, Message::Action, "waves", sender);
+            break;
+        default:
+            messages += Message(channel, Message::Plain, QString("message number %1 with some text").arg(i), sender);
+            break;
+        }
+    }
+}
+
+void tst_Convert::direct()
+{
+    QBENCHMARK {
+        foreach (const Message& message, messages)
+            qDeleteAll(Quassel::convertMessage(message, &connection));
+    }
+}
+
+void tst_Convert::fromParameters()
+{
+    QBENCHMARK {
+        foreach (const Message& message, messages) {
+            const QString buffer = message.bufferInfo().bufferName();
+            IrcMessage* msg = 0;
+            switch (message.type()) {
+            case Message::Join:
+                msg = IrcMessage::fromParameters(message.sender(), "JOIN", QStringList() << buffer, &connection);
+                break;
+            case Message::Quit:
+                msg = IrcMessage::fromParameters(message.sender(), "QUIT", QStringList() << message.contents(), &connection);
+                break;
+            case Message::Action:
+                msg = IrcMessage::fromParameters(message.sender(), "PRIVMSG", QStringList() << buffer << QString("\1ACTION %1\1").arg(message.contents()), &connection);
+                break;
+            default:
+                msg = IrcMessage::fromParameters(message.sender(), "PRIVMSG", QStringList() << buffer << message.contents(), &connection);
+                break;
+            }
+            msg->setTimeStamp(message.timestamp());
+            delete msg;
+        }
+    }
+}
+
+QTEST_MAIN(tst_Convert)
+
+#include "tst_convert.moc"
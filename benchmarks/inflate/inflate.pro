@@ -0,0 +1,14 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = app
+TARGET = tst_inflate
+CONFIG += testcase console communi
+CONFIG -= app_bundle
+QT = core network testlib
+COMMUNI += core
+
+SOURCES += tst_inflate.cpp
+
+include(../../quasselprotocol.pri)
@@ -0,0 +1,117 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselsocket.h"
+#include <QtTest/QtTest>
+#include <zlib.h>
+
+// Compares inflating a compressed core stream into reused buffers, as
+// QuasselSocket does, with a fresh output buffer per read.
+
+static const int ReadSize = 16 * 1024;
+
+class tst_Inflate : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void reused();
+    void allocated();
+
+private:
+    QList<QByteArray> chunks;
+    int total;
+};
+
+void tst_Inflate::initTestCase()
+{
+    QByteArray plain;
+    for (int i = 0; plain.size() < 8 * 1024 * 1024; ++i)
+        plain += QString(":nick%1!user@host PRIVMSG #channel%2 :message number %3 with some text\r\n").arg(i % 97).arg(i % 13).arg(i).toUtf8();
+    total = plain.size();
+
+    // compressed the way the core writes it, flushed in pieces
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    QCOMPARE(deflateInit(&stream, Z_BEST_COMPRESSION), Z_OK);
+    QByteArray compressed;
+    for (int i = 0; i < plain.size(); i += 4096) {
+        const int size = qMin(4096, plain.size() - i);
+        stream.next_in = reinterpret_cast<Bytef*>(plain.data() + i);
+        stream.avail_in = size;
+        do {
+            char out[16384];
+            stream.next_out = reinterpret_cast<Bytef*>(out);
+            stream.avail_out = sizeof(out);
+            QVERIFY(deflate(&stream, Z_SYNC_FLUSH) != Z_STREAM_ERROR);
+            compressed.append(out, sizeof(out) - stream.avail_out);
+        } while (stream.avail_out == 0);
+    }
+    deflateEnd(&stream);
+
+    // as the socket would hand them over
+    for (int i = 0; i < compressed.size(); i += ReadSize)
+        chunks += compressed.mid(i, ReadSize);
+}
+
+void tst_Inflate::reused()
+{
+    QBENCHMARK {
+        QuasselInflater inflater;
+        QByteArray buffer;
+        buffer.reserve(1024 * 1024);
+        int size = 0;
+        foreach (const QByteArray& chunk, chunks) {
+            QVERIFY(inflater.inflate(chunk.constData(), chunk.size(), &buffer));
+            size += buffer.size();
+            buffer.resize(0);
+        }
+        QCOMPARE(size, total);
+    }
+}
+
+void tst_Inflate::allocated()
+{
+    QBENCHMARK {
+        QuasselInflater inflater;
+        int size = 0;
+        foreach (const QByteArray& chunk, chunks) {
+            QByteArray buffer;
+            QVERIFY(inflater.inflate(chunk.constData(), chunk.size(), &buffer));
+            size += buffer.size();
+        }
+        QCOMPARE(size, total);
+    }
+}
+
+QTEST_MAIN(tst_Inflate)
+
+#include "tst_inflate.moc"
@@ -0,0 +1,189 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselactivity.h"
+#include <QTimer>
+
+// Per-buffer counters maintained as messages arrive. Backlog replies are
+// delivered oldest first and may overlap both the live stream and the
+// backlog of a previous session, so each buffer remembers the newest
+// message known before the live stream started and the oldest message of
+// the live stream, and only counts backlog that falls in between.
+
+static bool isUnread(const Message& message)
+{
+    return message.type() == Message::Plain || message.type() == Message::Notice || message.type() == Message::Action;
+}
+
+QuasselActivity::QuasselActivity(QObject* parent) : QObject(parent)
+{
+    d.timer = new QTimer(this);
+    d.timer->setInterval(50);
+    d.timer->setSingleShot(true);
+    connect(d.timer, SIGNAL(timeout()), this, SLOT(notify()));
+}
+
+int QuasselActivity::interval() const
+{
+    return d.timer->interval();
+}
+
+void QuasselActivity::setInterval(int msecs)
+{
+    d.timer->setInterval(msecs);
+}
+
+QList<BufferId> QuasselActivity::buffers() const
+{
+    return d.counters.keys();
+}
+
+int QuasselActivity::unreadCount(BufferId buffer) const
+{
+    return d.counters.value(buffer).unread;
+}
+
+int QuasselActivity::highlightCount(BufferId buffer) const
+{
+    return d.counters.value(buffer).highlights;
+}
+
+BufferInfo::ActivityLevel QuasselActivity::activity(BufferId buffer) const
+{
+    return d.counters.value(buffer).activity;
+}
+
+MsgId QuasselActivity::lastMsgId(BufferId buffer) const
+{
+    return d.counters.value(buffer).lastMsg;
+}
+
+MsgId QuasselActivity::lastSeenMsgId(BufferId buffer) const
+{
+    return d.counters.value(buffer).lastSeen;
+}
+
+void QuasselActivity::setLastSeenMsgId(BufferId buffer, MsgId msgId)
+{
+    // the counted messages are not kept, so the counters can only be
+    // cleared when everything counted has been seen. the core's last seen
+    // ids normally arrive before any backlog, which is then not counted
+    Counters& counters = d.counters[buffer];
+    if (msgId <= counters.lastSeen)
+        return;
+    counters.lastSeen = msgId;
+    if (msgId < counters.lastMsg)
+        return;
+    if (counters.unread || counters.highlights || counters.activity) {
+        counters.unread = 0;
+        counters.highlights = 0;
+        counters.activity = BufferInfo::NoActivity;
+        changed(buffer);
+    }
+}
+
+void QuasselActivity::markAsRead(BufferId buffer)
+{
+    setLastSeenMsgId(buffer, lastMsgId(buffer));
+}
+
+void QuasselActivity::update(const Message& message)
+{
+    const BufferId buffer = message.bufferInfo().bufferId();
+    const MsgId msgId = message.msgId();
+    Counters& counters = d.counters[buffer];
+
+    bool counted = false;
+    if (message.flags() & Message::Backlog) {
+        if (msgId > counters.backlogLast && (!counters.liveFirst.isValid() || msgId < counters.liveFirst)) {
+            counters.backlogLast = msgId;
+            counted = true;
+        }
+    } else if (msgId > counters.lastMsg) {
+        if (!counters.liveFirst.isValid())
+            counters.liveFirst = msgId;
+        counted = true;
+    }
+    if (!counted)
+        return;
+
+    if (msgId > counters.lastMsg)
+        counters.lastMsg = msgId;
+
+    if (message.flags() & Message::Self) {
+        // speaking in a buffer implies having read it
+        if (msgId > counters.lastSeen)
+            setLastSeenMsgId(buffer, msgId);
+        return;
+    }
+    if (msgId <= counters.lastSeen)
+        return;
+
+    if (isUnread(message)) {
+        ++counters.unread;
+        counters.activity |= BufferInfo::NewMessage;
+    } else {
+        counters.activity |= BufferInfo::OtherActivity;
+    }
+    if (message.flags() & Message::Highlight) {
+        ++counters.highlights;
+        counters.activity |= BufferInfo::Highlight;
+    }
+    changed(buffer);
+}
+
+void QuasselActivity::restart()
+{
+    // a new session: everything counted so far is backlog from now on
+    QHash<BufferId, Counters>::iterator it;
+    for (it = d.counters.begin(); it != d.counters.end(); ++it) {
+        it->backlogLast = it->lastMsg;
+        it->liveFirst = MsgId();
+    }
+}
+
+void QuasselActivity::clear()
+{
+    d.counters.clear();
+    d.changed.clear();
+    d.timer->stop();
+}
+
+void QuasselActivity::notify()
+{
+    QList<BufferId> buffers = d.changed.toList();
+    d.changed.clear();
+    emit countersChanged(buffers);
+}
+
+void QuasselActivity::changed(BufferId buffer)
+{
+    d.changed.insert(buffer);
+    if (!d.timer->isActive())
+        d.timer->start();
+}
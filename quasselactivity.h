@@ -0,0 +1,94 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUASSELACTIVITY_H
+#define QUASSELACTIVITY_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include "bufferinfo.h"
+#include "message.h"
+
+class QTimer;
+
+class QuasselActivity : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QuasselActivity(QObject* parent = 0);
+
+    int interval() const;
+    void setInterval(int msecs);
+
+    QList<BufferId> buffers() const;
+
+    int unreadCount(BufferId buffer) const;
+    int highlightCount(BufferId buffer) const;
+    BufferInfo::ActivityLevel activity(BufferId buffer) const;
+    MsgId lastMsgId(BufferId buffer) const;
+
+    MsgId lastSeenMsgId(BufferId buffer) const;
+    void markAsRead(BufferId buffer);
+
+    void update(const Message& message);
+    void restart();
+    void clear();
+
+public slots:
+    void setLastSeenMsgId(BufferId buffer, MsgId msgId);
+
+signals:
+    void countersChanged(const QList<BufferId>& buffers);
+
+private slots:
+    void notify();
+
+private:
+    struct Counters {
+        Counters() : unread(0), highlights(0), activity(BufferInfo::NoActivity) { }
+        int unread;
+        int highlights;
+        BufferInfo::ActivityLevel activity;
+        MsgId lastMsg;
+        MsgId lastSeen;
+        MsgId backlogLast; // newest message known before the live stream
+        MsgId liveFirst; // oldest message of the current live stream
+    };
+
+    void changed(BufferId buffer);
+
+    struct Private {
+        QTimer* timer;
+        QHash<BufferId, Counters> counters;
+        QSet<BufferId> changed;
+    } d;
+};
+
+#endif // QUASSELACTIVITY_H
@@ -27,6 +27,9 @@
 */
 
 #include "quasselauthhandler.h"
+#include "quasselsocket.h"
+#include "quasselcapture.h"
+#include "quasseldebug.h"
 #include "datastreampeer.h"
 #include "legacypeer.h"
 #include "compressor.h"
@@ -41,6 +44,8 @@ QuasselAuthHandler::QuasselAuthHandler(IrcConnection* connection) : AuthHandler(
     d.peer = 0;
     d.legacy = false;
     d.probing = false;
+    d.threaded = false;
+    d.capture = 0;
     d.connection = connection;
 
     QTcpSocket* socket = qobject_cast<QTcpSocket*>(connection->socket());
@@ -71,6 +76,26 @@ bool QuasselAuthHandler::isProbing() const
     return d.probing;
 }
 
+bool QuasselAuthHandler::isThreaded() const
+{
+    return d.threaded;
+}
+
+void QuasselAuthHandler::setThreaded(bool threaded)
+{
+    d.threaded = threaded;
+}
+
+QuasselCapture* QuasselAuthHandler::capture() const
+{
+    return d.capture;
+}
+
+void QuasselAuthHandler::setCapture(QuasselCapture* capture)
+{
+    d.capture = capture;
+}
+
 void QuasselAuthHandler::authenticate()
 {
     onSocketConnected();
@@ -122,6 +147,8 @@ void QuasselAuthHandler::onReadyRead()
 
     quint32 reply;
     socket()->read((char*)&reply, 4);
+    if (d.capture)
+        d.capture->write(QByteArray((char*)&reply, 4));
     reply = qFromBigEndian<quint32>(reply);
 
     Protocol::Type type = static_cast<Protocol::Type>(reply & 0xff);
@@ -131,11 +158,14 @@ void QuasselAuthHandler::onReadyRead()
         if (connectionFeatures & Protocol::Compression)
             compression = Compressor::BestCompression;
 
+        QTcpSocket* socket = peerSocket(compression != Compressor::NoCompression, type == Protocol::DataStreamProtocol);
+        compression = Compressor::NoCompression;
+
         if (type == Protocol::DataStreamProtocol) {
             quint16 protoFeatures = static_cast<quint16>(reply >> 8 & 0xffff);
-            setPeer(new DataStreamPeer(this, socket(), protoFeatures, compression, d.connection));
+            setPeer(new DataStreamPeer(this, socket, protoFeatures, compression, d.connection));
         } else {
-            setPeer(new LegacyPeer(this, socket(), compression, d.connection));
+            setPeer(new LegacyPeer(this, socket, compression, d.connection));
         }
     } else {
         emit protocolUnsupported();
@@ -168,7 +198,7 @@ void QuasselAuthHandler::onSocketConnected()
         return;
     }
 
-    setPeer(new LegacyPeer(this, socket(), Compressor::NoCompression, d.connection));
+    setPeer(new LegacyPeer(this, peerSocket(false, false), Compressor::NoCompression, d.connection));
 }
 
 void QuasselAuthHandler::onSocketDisconnected()
@@ -177,7 +207,7 @@ void QuasselAuthHandler::onSocketDisconnected()
         // Remote host has closed the connection while probing
         d.probing = false;
         disconnect(socket(), SIGNAL(readyRead()), this, SLOT(onReadyRead()));
-        qDebug("Reconnecting in compatibility mode...");
+        qQuasselDebug() << "Reconnecting in compatibility mode...";
         d.connection->open();
         return;
     }
@@ -213,3 +243,15 @@ void QuasselAuthHandler::setPeer(RemotePeer* peer)
     socket()->setParent(d.connection); // reclaim ownership from RemotePeer
     login();
 }
+
+QTcpSocket* QuasselAuthHandler::peerSocket(bool compressed, bool filtered)
+{
+    // the peer always reads through QuasselSocket that inflates with
+    // reusable buffers, optionally in a dedicated thread, feeds the
+    // capture, filters sync calls of the DataStream protocol and can be
+    // paused while the message queue is congested
+    QuasselSocket* socket = new QuasselSocket(this->socket(), compressed, d.threaded);
+    socket->setCapture(d.capture);
+    socket->setFramed(filtered);
+    return socket;
+}
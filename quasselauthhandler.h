@@ -34,6 +34,7 @@
 
 struct NetworkId;
 class RemotePeer;
+class QuasselCapture;
 IRC_FORWARD_DECLARE_CLASS(IrcConnection)
 
 class QuasselAuthHandler : public AuthHandler
@@ -48,6 +49,12 @@ public:
     NetworkId networkId() const;
     bool isProbing() const;
 
+    bool isThreaded() const;
+    void setThreaded(bool threaded);
+
+    QuasselCapture* capture() const;
+    void setCapture(QuasselCapture* capture);
+
 public slots:
     void authenticate();
 
@@ -77,11 +84,14 @@ private slots:
 private:
     void login();
     void setPeer(RemotePeer* peer);
+    QTcpSocket* peerSocket(bool compressed, bool filtered);
 
     struct Private {
         bool legacy;
         bool probing;
+        bool threaded;
         RemotePeer* peer;
+        QuasselCapture* capture;
         IrcConnection* connection;
     } d;
 };
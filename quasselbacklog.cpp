@@ -27,25 +27,166 @@
 */
 
 #include "quasselbacklog.h"
+#include "quasselqueue.h"
 #include "message.h"
 
+// Backlog replies arrive as one decoded list per request, so the budget
+// limits how many bytes worth of replies may be outstanding or waiting in
+// the delivery queue at a time. Request sizes are estimated from the
+// average size of received messages.
+
+static qint64 messageSize(const Message& message)
+{
+    return sizeof(Message) + sizeof(QVariant) + (message.contents().size() + message.sender().size()) * sizeof(QChar);
+}
+
 QuasselBacklog::QuasselBacklog(QObject *parent) : BacklogManager(parent)
 {
+    d.types = -1;
+    d.flags = -1;
+    d.supported = false;
+    d.size = 0;
+    d.maxSize = 8 * 1024 * 1024;
+    d.average = 256;
+}
+
+int QuasselBacklog::typeFilter() const
+{
+    return d.types;
+}
+
+void QuasselBacklog::setTypeFilter(int types)
+{
+    d.types = types;
+}
+
+int QuasselBacklog::flagFilter() const
+{
+    return d.flags;
+}
+
+void QuasselBacklog::setFlagFilter(int flags)
+{
+    d.flags = flags;
+}
+
+bool QuasselBacklog::isFilterSupported() const
+{
+    return d.supported;
+}
+
+void QuasselBacklog::setFilterSupported(bool supported)
+{
+    d.supported = supported;
+}
+
+QuasselQueue* QuasselBacklog::queue() const
+{
+    return d.queue;
+}
+
+void QuasselBacklog::setQueue(QuasselQueue* queue)
+{
+    if (d.queue != queue) {
+        if (d.queue)
+            disconnect(d.queue, 0, this, 0);
+        d.queue = queue;
+        if (queue) {
+            connect(queue, SIGNAL(messageDequeued(Message)), this, SLOT(onMessageReleased(Message)));
+            connect(queue, SIGNAL(messageDropped(Message)), this, SLOT(onMessageReleased(Message)));
+        }
+    }
+}
+
+qint64 QuasselBacklog::size() const
+{
+    return d.size + (d.queue ? d.queue->backlogSize() : 0);
+}
+
+int QuasselBacklog::pendingCount() const
+{
+    return d.pending.count();
+}
+
+qint64 QuasselBacklog::maximumSize() const
+{
+    return d.maxSize;
+}
+
+void QuasselBacklog::setMaximumSize(qint64 size)
+{
+    d.maxSize = size;
+}
+
+void QuasselBacklog::fetchBacklog(BufferId buffer, MsgId first, MsgId last, int limit)
+{
+    Request request;
+    request.buffer = buffer;
+    request.first = first;
+    request.last = last;
+    request.limit = limit;
+    request.size = qMax(limit, 1) * d.average;
+
+    d.pending.enqueue(request);
+    sendPending();
+}
+
+void QuasselBacklog::clear()
+{
+    d.size = 0;
+    d.pending.clear();
+    d.requests.clear();
+}
+
+void QuasselBacklog::sendRequest(const Request& request)
+{
+    d.size += request.size;
+    d.requests[request.buffer].enqueue(request.size);
+#ifdef HAVE_BACKLOG_FILTER
+    if (d.supported && (d.types != -1 || d.flags != -1)) {
+        requestBacklogFiltered(request.buffer, request.first, request.last, request.limit, 0, d.types, d.flags);
+        return;
+    }
+#endif
+    requestBacklog(request.buffer, request.first, request.last, request.limit);
+}
+
+void QuasselBacklog::finishRequest(BufferId buffer)
+{
+    QHash<BufferId, QQueue<qint64> >::iterator it = d.requests.find(buffer);
+    if (it != d.requests.end()) {
+        d.size -= it->dequeue();
+        if (it->isEmpty())
+            d.requests.erase(it);
+    }
+    sendPending();
+}
+
+void QuasselBacklog::sendPending()
+{
+    // a single request larger than the budget is sent once nothing else is outstanding
+    while (!d.pending.isEmpty()) {
+        const qint64 used = size();
+        if (used && used + d.pending.head().size > d.maxSize)
+            break;
+        sendRequest(d.pending.dequeue());
+    }
+}
+
+void QuasselBacklog::onMessageReleased(const Message& message)
+{
+    if (!d.pending.isEmpty() && message.flags() & Message::Backlog)
+        sendPending();
 }
 
 void QuasselBacklog::receiveBacklog(BufferId buffer, MsgId first, MsgId last, int limit, int additional, QVariantList msgs)
 {
-    Q_UNUSED(buffer)
     Q_UNUSED(first)
-    Q_UNUSED(last)
     Q_UNUSED(limit)
     Q_UNUSED(additional)
 
-    for (int i = msgs.count() - 1; i >= 0; --i) {
-        Message msg = msgs.at(i).value<Message>();
-        msg.setFlags(msg.flags() | Message::Backlog);
-        emit messageReceived(msg);
-    }
+    receiveMessages(buffer, last, msgs);
+    finishRequest(buffer);
 }
 
 void QuasselBacklog::receiveBacklogAll(MsgId first, MsgId last, int limit, int additional, QVariantList msgs)
@@ -55,9 +196,42 @@ void QuasselBacklog::receiveBacklogAll(MsgId first, MsgId last, int limit, int a
     Q_UNUSED(limit)
     Q_UNUSED(additional)
 
-    for (int i = msgs.count() - 1; i >= 0; --i) {
+    receiveMessages(BufferId(), MsgId(), msgs);
+}
+
+#ifdef HAVE_BACKLOG_FILTER
+void QuasselBacklog::receiveBacklogFiltered(BufferId buffer, MsgId first, MsgId last, int limit, int additional, int type, int flags, QVariantList msgs)
+{
+    Q_UNUSED(first)
+    Q_UNUSED(limit)
+    Q_UNUSED(additional)
+    Q_UNUSED(type)
+    Q_UNUSED(flags)
+
+    receiveMessages(buffer, last, msgs);
+    finishRequest(buffer);
+}
+#endif
+
+void QuasselBacklog::receiveMessages(BufferId buffer, MsgId last, const QVariantList& msgs)
+{
+    // the core replies newest first
+    const int count = msgs.count();
+    qint64 size = 0;
+    MsgId first;
+    for (int i = count - 1; i >= 0; --i) {
         Message msg = msgs.at(i).value<Message>();
+        size += messageSize(msg);
+        if (i == count - 1)
+            first = msg.msgId();
+        // the core may not support filtering, so filter on the client side as well
+        if (!(msg.type() & d.types) || (d.flags != -1 && !(msg.flags() & d.flags)))
+            continue;
         msg.setFlags(msg.flags() | Message::Backlog);
         emit messageReceived(msg);
     }
+    if (count)
+        d.average = qMax<qint64>(1, (7 * d.average + size / count) / 8);
+    if (buffer.isValid() && first.isValid())
+        emit pageReceived(buffer, first, last);
 }
@@ -30,8 +30,12 @@
 #define QUASSELBACKLOG_H
 
 #include "backlogmanager.h"
+#include <QHash>
+#include <QPointer>
+#include <QQueue>
 
 class Message;
+class QuasselQueue;
 
 class QuasselBacklog : public BacklogManager
 {
@@ -40,12 +44,66 @@ class QuasselBacklog : public BacklogManager
 public:
     QuasselBacklog(QObject *parent = 0);
 
+    int typeFilter() const;
+    void setTypeFilter(int types);
+
+    int flagFilter() const;
+    void setFlagFilter(int flags);
+
+    bool isFilterSupported() const;
+    void setFilterSupported(bool supported);
+
+    QuasselQueue* queue() const;
+    void setQueue(QuasselQueue* queue);
+
+    qint64 size() const;
+    int pendingCount() const;
+
+    qint64 maximumSize() const;
+    void setMaximumSize(qint64 size);
+
+    void fetchBacklog(BufferId buffer, MsgId first, MsgId last, int limit);
+    void clear();
+
 public slots:
     void receiveBacklog(BufferId buffer, MsgId first, MsgId last, int limit, int additional, QVariantList msgs);
     void receiveBacklogAll(MsgId first, MsgId last, int limit, int additional, QVariantList msgs);
+#ifdef HAVE_BACKLOG_FILTER
+    void receiveBacklogFiltered(BufferId buffer, MsgId first, MsgId last, int limit, int additional, int type, int flags, QVariantList msgs);
+#endif
 
 signals:
     void messageReceived(const Message& message);
+    void pageReceived(BufferId buffer, MsgId first, MsgId last);
+
+private slots:
+    void onMessageReleased(const Message& message);
+
+private:
+    struct Request {
+        BufferId buffer;
+        MsgId first;
+        MsgId last;
+        int limit;
+        qint64 size;
+    };
+
+    void sendRequest(const Request& request);
+    void finishRequest(BufferId buffer);
+    void sendPending();
+    void receiveMessages(BufferId buffer, MsgId last, const QVariantList& msgs);
+
+    struct Private {
+        int types;
+        int flags;
+        bool supported;
+        qint64 size; // estimated size of the outstanding replies
+        qint64 maxSize;
+        qint64 average;
+        QPointer<QuasselQueue> queue;
+        QQueue<Request> pending;
+        QHash<BufferId, QQueue<qint64> > requests; // buffer -> estimated sizes
+    } d;
 };
 
 #endif // QUASSELBACKLOG_H
@@ -0,0 +1,68 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselcapture.h"
+
+QuasselCapture::QuasselCapture(const QString& fileName, QObject* parent) : QObject(parent)
+{
+    d.file.setFileName(fileName);
+}
+
+QString QuasselCapture::fileName() const
+{
+    return d.file.fileName();
+}
+
+bool QuasselCapture::open()
+{
+    if (!d.file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    d.stream.setDevice(&d.file);
+    d.stream << quint32(Magic) << quint32(Version);
+    d.timer.start();
+    return true;
+}
+
+void QuasselCapture::close()
+{
+    d.stream.setDevice(0);
+    d.file.close();
+}
+
+bool QuasselCapture::isOpen() const
+{
+    return d.file.isOpen();
+}
+
+void QuasselCapture::write(const QByteArray& data)
+{
+    // frame: milliseconds since the capture was opened, raw inbound bytes
+    if (d.file.isOpen())
+        d.stream << d.timer.elapsed() << data;
+}
@@ -0,0 +1,411 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselfanout.h"
+#include "quasselprotocol.h"
+#include "quasselscrollback.h"
+#include "quasselmessage.h"
+#include "quasselqueue.h"
+#include "ircchannel.h"
+#include "ircuser.h"
+#include "network.h"
+#include "message.h"
+#include <IrcConnection>
+#include <IrcMessage>
+#include <IrcNetwork>
+#include <QTcpSocket>
+#include <algorithm>
+
+IRC_USE_NAMESPACE
+
+// Serves the session of one QuasselProtocol to local IRC clients, so that
+// several processes can share a single core connection. Clients speak
+// plain IRC over loopback TCP (IrcConnection requires a QAbstractSocket,
+// which rules out local sockets), get the current channel state and the
+// cached scrollback on registration, then every message the protocol
+// delivers. Their own lines are written to the core through the protocol.
+// Any local user can connect over TCP, so a password is required. Clients
+// that negotiate server-time and batch can tell the replayed scrollback
+// and backlog from live lines.
+
+static const char* ServerName = "quassel";
+static const char* Capabilities = "server-time batch";
+
+static QByteArray toLine(const QString& prefix, const QString& command, const QStringList& params)
+{
+    QString line;
+    if (!prefix.isEmpty())
+        line += ":" + prefix + " ";
+    line += command;
+    for (int i = 0; i < params.count(); ++i) {
+        const QString& param = params.at(i);
+        if (i == params.count() - 1 && (param.isEmpty() || param.contains(' ') || param.startsWith(':')))
+            line += " :" + param;
+        else
+            line += " " + param;
+    }
+    return line.toUtf8();
+}
+
+static QByteArray timeTag(const QDateTime& time)
+{
+    return time.toUTC().toString("yyyy-MM-ddThh:mm:ss.zzzZ").toLatin1();
+}
+
+static QByteArray namesLine(const QString& prefix, const QString& nick, const QString& channel, const QStringList& names)
+{
+    return toLine(prefix, QString::number(Irc::RPL_NAMREPLY), QStringList() << nick << "=" << channel << names.join(" "));
+}
+
+QuasselFanout::QuasselFanout(QuasselProtocol* protocol, QObject* parent) : QTcpServer(parent)
+{
+    d.backlog = 50;
+    d.maxPending = 4 * 1024 * 1024;
+    d.batches = 0;
+    d.protocol = protocol;
+
+    connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+    connect(protocol->connection(), SIGNAL(messageReceived(IrcMessage*)), this, SLOT(onMessageReceived(IrcMessage*)));
+}
+
+QuasselProtocol* QuasselFanout::protocol() const
+{
+    return d.protocol;
+}
+
+int QuasselFanout::clientCount() const
+{
+    return d.clients.count();
+}
+
+QString QuasselFanout::password() const
+{
+    return d.password;
+}
+
+void QuasselFanout::setPassword(const QString& password)
+{
+    d.password = password;
+}
+
+bool QuasselFanout::listen(const QHostAddress& address, quint16 port)
+{
+    // hides QTcpServer::listen(), connections are refused anyway without a password
+    if (d.password.isEmpty())
+        return false;
+    return QTcpServer::listen(address, port);
+}
+
+int QuasselFanout::backlogCount() const
+{
+    return d.backlog;
+}
+
+void QuasselFanout::setBacklogCount(int count)
+{
+    d.backlog = count;
+}
+
+qint64 QuasselFanout::maximumPending() const
+{
+    return d.maxPending;
+}
+
+void QuasselFanout::setMaximumPending(qint64 bytes)
+{
+    d.maxPending = bytes;
+}
+
+void QuasselFanout::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket* socket = nextPendingConnection();
+        if (d.password.isEmpty() || !socket->peerAddress().isLoopback()) {
+            socket->close();
+            socket->deleteLater();
+            continue;
+        }
+        d.clients.insert(socket, Client());
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    }
+}
+
+void QuasselFanout::onReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    while (socket && socket->canReadLine() && d.clients.contains(socket)) {
+        QByteArray line = socket->readLine();
+        while (line.endsWith('\n') || line.endsWith('\r'))
+            line.chop(1);
+        if (!line.isEmpty())
+            handleLine(socket, line);
+    }
+}
+
+void QuasselFanout::onDisconnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (socket) {
+        d.clients.remove(socket);
+        socket->deleteLater();
+    }
+}
+
+void QuasselFanout::onMessageReceived(IrcMessage* message)
+{
+    if (d.clients.isEmpty())
+        return;
+
+    if (message->type() == IrcMessage::Names) {
+        // the protocol delivers names as a single pseudo message
+        const QStringList params = message->parameters();
+        const QString nick = d.protocol->connection()->nickName();
+        broadcast(namesLine(ServerName, nick, params.value(0), params.mid(1)));
+        broadcast(toLine(ServerName, QString::number(Irc::RPL_ENDOFNAMES), QStringList() << nick << params.value(0) << "End of /NAMES list."));
+        return;
+    }
+    broadcast(toLine(message->prefix(), message->command(), message->parameters()), 0, message->timeStamp());
+}
+
+void QuasselFanout::handleLine(QTcpSocket* socket, const QByteArray& line)
+{
+    Client& client = d.clients[socket];
+    const QString data = QString::fromUtf8(line);
+    const QString command = data.section(' ', 0, 0).toUpper();
+    const QString args = data.section(' ', 1);
+
+    if (command == "PING") {
+        send(socket, toLine(ServerName, "PONG", QStringList() << ServerName << args.mid(args.startsWith(':'))));
+    } else if (command == "QUIT") {
+        socket->disconnectFromHost();
+    } else if (command == "CAP") {
+        handleCap(socket, args);
+        if (d.clients.contains(socket) && !client.registered && !client.negotiating && !client.nick.isEmpty() && !client.user.isEmpty())
+            registerClient(socket);
+    } else if (!client.registered) {
+        if (command == "PASS") {
+            client.pass = args.mid(args.startsWith(':'));
+        } else if (command == "NICK") {
+            client.nick = args.section(' ', 0, 0);
+        } else if (command == "USER") {
+            client.user = args.section(' ', 0, 0);
+        }
+        if (!client.negotiating && !client.nick.isEmpty() && !client.user.isEmpty())
+            registerClient(socket);
+    } else if (d.protocol->network() && command != "CAP" && command != "NICK" && command != "USER" && command != "PASS") {
+        // own messages are not echoed by the core, let the other clients see them
+        if (command == "PRIVMSG" || command == "NOTICE")
+            broadcast(":" + prefix() + " " + line, socket);
+        d.protocol->write(line);
+    }
+}
+
+void QuasselFanout::handleCap(QTcpSocket* socket, const QString& args)
+{
+    Client& client = d.clients[socket];
+    const QString subcommand = args.section(' ', 0, 0).toUpper();
+    const QString target = client.registered ? d.protocol->connection()->nickName() : QString("*");
+
+    if (subcommand == "LS") {
+        client.negotiating = !client.registered;
+        send(socket, toLine(ServerName, "CAP", QStringList() << target << "LS" << Capabilities));
+    } else if (subcommand == "LIST") {
+        QStringList enabled;
+        if (client.serverTime)
+            enabled += "server-time";
+        if (client.batch)
+            enabled += "batch";
+        send(socket, toLine(ServerName, "CAP", QStringList() << target << "LIST" << enabled.join(" ")));
+    } else if (subcommand == "REQ") {
+        // a request is acknowledged or refused as a whole
+        client.negotiating = !client.registered;
+        QString caps = args.section(' ', 1);
+        if (caps.startsWith(':'))
+            caps.remove(0, 1);
+        const QStringList requested = caps.split(' ', QString::SkipEmptyParts);
+        bool supported = !requested.isEmpty();
+        foreach (const QString& cap, requested) {
+            const QString name = cap.startsWith('-') ? cap.mid(1) : cap;
+            if (name != "server-time" && name != "batch")
+                supported = false;
+        }
+        if (supported) {
+            foreach (const QString& cap, requested) {
+                const bool enable = !cap.startsWith('-');
+                if (cap.endsWith("server-time"))
+                    client.serverTime = enable;
+                else
+                    client.batch = enable;
+            }
+        }
+        send(socket, toLine(ServerName, "CAP", QStringList() << target << (supported ? "ACK" : "NAK") << requested.join(" ")));
+    } else if (subcommand == "END") {
+        client.negotiating = false;
+    }
+}
+
+void QuasselFanout::registerClient(QTcpSocket* socket)
+{
+    Client& client = d.clients[socket];
+    if (d.password.isEmpty() || client.pass != d.password) {
+        send(socket, toLine(ServerName, QString::number(Irc::ERR_PASSWDMISMATCH), QStringList() << client.nick << "Password incorrect"));
+        send(socket, toLine(QString(), "ERROR", QStringList() << "Closing link: password incorrect"));
+        d.clients.remove(socket);
+        socket->disconnectFromHost();
+        return;
+    }
+
+    client.registered = true;
+    IrcConnection* connection = d.protocol->connection();
+    IrcNetwork* network = connection->network();
+    const QString nick = connection->nickName();
+
+    // everyone shares the nick of the core session
+    if (client.nick != nick)
+        send(socket, toLine(client.nick, "NICK", QStringList() << nick));
+    send(socket, reply(Irc::RPL_WELCOME, QStringList() << "Welcome to the shared Quassel session " + prefix()));
+
+    QStringList support;
+    if (!network->name().isEmpty())
+        support += "NETWORK=" + network->name();
+    if (!network->modes().isEmpty())
+        support += "PREFIX=(" + network->modes().join("") + ")" + network->prefixes().join("");
+    if (!network->channelTypes().isEmpty())
+        support += "CHANTYPES=" + network->channelTypes().join("");
+    send(socket, reply(Irc::RPL_ISUPPORT, support << "are supported by this server"));
+    send(socket, reply(Irc::ERR_NOMOTD, QStringList() << "MOTD File is missing"));
+
+    sendState(socket);
+}
+
+void QuasselFanout::sendState(QTcpSocket* socket)
+{
+    IrcConnection* connection = d.protocol->connection();
+    const QString nick = connection->nickName();
+
+    Network* network = d.protocol->network();
+    if (network) {
+        foreach (const QString& name, network->channels()) {
+            IrcChannel* channel = network->ircChannel(name);
+            if (!channel || !channel->isInitialized())
+                continue;
+
+            send(socket, toLine(prefix(), "JOIN", QStringList() << channel->name()));
+            if (!channel->topic().isEmpty())
+                send(socket, reply(Irc::RPL_TOPIC, QStringList() << channel->name() << channel->topic()));
+            else
+                send(socket, reply(Irc::RPL_NOTOPIC, QStringList() << channel->name() << "No topic is set"));
+
+            QStringList names;
+            foreach (IrcUser* user, channel->ircUsers()) {
+                QString modes = channel->userModes(user->nick());
+                names += (modes.isEmpty() ? QString() : network->modeToPrefix(modes)) + user->nick();
+                if (names.count() == 50) {
+                    send(socket, namesLine(ServerName, nick, channel->name(), names));
+                    names.clear();
+                }
+            }
+            if (!names.isEmpty())
+                send(socket, namesLine(ServerName, nick, channel->name(), names));
+            send(socket, reply(Irc::RPL_ENDOFNAMES, QStringList() << channel->name() << "End of /NAMES list."));
+        }
+    }
+
+    // replay the cached scrollback, without going back to the core, as a
+    // chathistory batch per buffer. the messages still waiting in the queue
+    // reach every client once delivered
+    const bool batched = d.clients.value(socket).batch;
+    QuasselScrollback* scrollback = d.protocol->scrollback();
+    foreach (BufferId buffer, scrollback->buffers()) {
+        const QList<Message> messages = scrollback->messages(buffer, MsgId(), d.backlog);
+        if (messages.isEmpty())
+            continue;
+
+        QList<MsgId> queued = d.protocol->queue()->msgIds(buffer);
+        std::sort(queued.begin(), queued.end());
+        const QByteArray batch = batched ? "history" + QByteArray::number(++d.batches) : QByteArray();
+        if (batched)
+            send(socket, toLine(ServerName, "BATCH", QStringList() << "+" + batch << "chathistory" << messages.first().bufferInfo().bufferName()));
+        foreach (const Message& message, messages) {
+            if (std::binary_search(queued.begin(), queued.end(), message.msgId()))
+                continue;
+            QList<IrcMessage*> msgs = Quassel::convertMessage(message, connection);
+            foreach (IrcMessage* msg, msgs) {
+                send(socket, toLine(msg->prefix(), msg->command(), msg->parameters()), msg->timeStamp(), batch);
+                delete msg;
+            }
+        }
+        if (batched)
+            send(socket, toLine(ServerName, "BATCH", QStringList() << "-" + batch));
+    }
+}
+
+void QuasselFanout::send(QTcpSocket* socket, const QByteArray& line, const QDateTime& time, const QByteArray& batch)
+{
+    if (!d.clients.contains(socket))
+        return;
+
+    // drop clients that do not keep up instead of buffering without bounds
+    if (d.maxPending > 0 && socket->bytesToWrite() > d.maxPending) {
+        d.clients.remove(socket);
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+
+    // tags only go to the clients that negotiated them
+    const Client& client = d.clients[socket];
+    QByteArray tags;
+    if (client.serverTime && time.isValid())
+        tags += ";time=" + timeTag(time);
+    if (client.batch && !batch.isEmpty())
+        tags += ";batch=" + batch;
+    if (!tags.isEmpty())
+        socket->write("@" + tags.mid(1) + " ");
+    socket->write(line + "\r\n");
+}
+
+void QuasselFanout::broadcast(const QByteArray& line, QTcpSocket* except, const QDateTime& time)
+{
+    foreach (QTcpSocket* socket, d.clients.keys()) {
+        if (socket != except && d.clients.value(socket).registered)
+            send(socket, line, time);
+    }
+}
+
+QByteArray QuasselFanout::reply(int code, const QStringList& params) const
+{
+    return toLine(ServerName, QString::number(code).rightJustified(3, '0'), QStringList() << d.protocol->connection()->nickName() << params);
+}
+
+QByteArray QuasselFanout::prefix() const
+{
+    IrcConnection* connection = d.protocol->connection();
+    return QString(connection->nickName() + "!" + connection->userName() + "@quassel").toUtf8();
+}
@@ -0,0 +1,99 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUASSELFANOUT_H
+#define QUASSELFANOUT_H
+
+#include <IrcGlobal>
+#include <QTcpServer>
+#include <QDateTime>
+#include <QHash>
+
+class QTcpSocket;
+class QuasselProtocol;
+IRC_FORWARD_DECLARE_CLASS(IrcMessage)
+
+class QuasselFanout : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit QuasselFanout(QuasselProtocol* protocol, QObject* parent = 0);
+
+    QuasselProtocol* protocol() const;
+    int clientCount() const;
+
+    QString password() const;
+    void setPassword(const QString& password);
+
+    bool listen(const QHostAddress& address = QHostAddress::LocalHost, quint16 port = 0);
+
+    int backlogCount() const;
+    void setBacklogCount(int count);
+
+    qint64 maximumPending() const;
+    void setMaximumPending(qint64 bytes);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onMessageReceived(IrcMessage* message);
+
+private:
+    struct Client {
+        Client() : registered(false), negotiating(false), serverTime(false), batch(false) { }
+        bool registered;
+        bool negotiating; // registration waits for CAP END
+        bool serverTime;
+        bool batch;
+        QString pass;
+        QString nick;
+        QString user;
+    };
+
+    void handleLine(QTcpSocket* socket, const QByteArray& line);
+    void handleCap(QTcpSocket* socket, const QString& args);
+    void registerClient(QTcpSocket* socket);
+    void sendState(QTcpSocket* socket);
+    void send(QTcpSocket* socket, const QByteArray& line, const QDateTime& time = QDateTime(), const QByteArray& batch = QByteArray());
+    void broadcast(const QByteArray& line, QTcpSocket* except = 0, const QDateTime& time = QDateTime());
+    QByteArray reply(int code, const QStringList& params) const;
+    QByteArray prefix() const;
+
+    struct Private {
+        int backlog;
+        qint64 maxPending;
+        int batches;
+        QString password;
+        QuasselProtocol* protocol;
+        QHash<QTcpSocket*, Client> clients;
+    } d;
+};
+
+#endif // QUASSELFANOUT_H
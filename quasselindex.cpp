@@ -0,0 +1,229 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselindex.h"
+#include <QDataStream>
+#include <QSet>
+#include <algorithm>
+
+// Inverted index from case-folded word tokens to the ids of the messages
+// containing them. Message ids grow over time, so sorting by id ranks by
+// recency and evicting the lowest ids drops the oldest messages. Evicted
+// ids are removed from the posting lists lazily, in batches.
+
+static QSet<QString> tokenize(const QString& text)
+{
+    QSet<QString> tokens;
+    const QString folded = text.toCaseFolded();
+    int start = -1;
+    for (int i = 0; i <= folded.length(); ++i) {
+        if (i < folded.length() && folded.at(i).isLetterOrNumber()) {
+            if (start == -1)
+                start = i;
+        } else if (start != -1) {
+            if (i - start > 1)
+                tokens.insert(folded.mid(start, i - start));
+            start = -1;
+        }
+    }
+    return tokens;
+}
+
+QuasselIndex::QuasselIndex()
+{
+    d.maxCount = 100000;
+    d.evicted = 0;
+}
+
+int QuasselIndex::count() const
+{
+    return d.documents.count();
+}
+
+int QuasselIndex::maximumCount() const
+{
+    return d.maxCount;
+}
+
+void QuasselIndex::setMaximumCount(int count)
+{
+    d.maxCount = count;
+    reduce();
+}
+
+void QuasselIndex::insert(BufferId buffer, MsgId msgId, const QString& text)
+{
+    if (!msgId.isValid() || d.documents.contains(msgId))
+        return;
+    // older than everything kept in a full index, it would be evicted right away
+    if (d.documents.count() >= d.maxCount && (d.documents.isEmpty() || msgId < d.documents.firstKey()))
+        return;
+
+    foreach (const QString& token, tokenize(text)) {
+        QVector<MsgId>& ids = d.postings[token];
+        if (ids.isEmpty() || ids.last() < msgId) {
+            ids.append(msgId);
+        } else {
+            // an evicted id may still be listed when its message comes back
+            QVector<MsgId>::iterator it = std::lower_bound(ids.begin(), ids.end(), msgId);
+            if (it == ids.end() || *it != msgId)
+                ids.insert(it, msgId);
+        }
+    }
+    d.documents.insert(msgId, buffer);
+    reduce();
+}
+
+QList<QuasselIndex::Hit> QuasselIndex::search(const QString& query, int limit) const
+{
+    QList<Hit> hits;
+    QVector<MsgId> ids;
+    bool first = true;
+    foreach (const QString& term, query.split(' ', QString::SkipEmptyParts)) {
+        QVector<MsgId> matches = lookup(term);
+        if (first) {
+            ids = matches;
+            first = false;
+        } else {
+            QVector<MsgId> both(qMin(ids.count(), matches.count()));
+            both.resize(std::set_intersection(ids.constBegin(), ids.constEnd(), matches.constBegin(), matches.constEnd(), both.begin()) - both.begin());
+            ids = both;
+        }
+        if (ids.isEmpty())
+            return hits;
+    }
+
+    // newest first, skipping evicted messages
+    for (int i = ids.count() - 1; i >= 0 && hits.count() < limit; --i) {
+        QMap<MsgId, BufferId>::const_iterator it = d.documents.find(ids.at(i));
+        if (it != d.documents.constEnd()) {
+            Hit hit;
+            hit.buffer = it.value();
+            hit.msgId = it.key();
+            hits += hit;
+        }
+    }
+    return hits;
+}
+
+void QuasselIndex::clear()
+{
+    d.evicted = 0;
+    d.documents.clear();
+    d.postings.clear();
+}
+
+bool QuasselIndex::save(QIODevice* device) const
+{
+    QDataStream stream(device);
+    stream << quint32(Magic) << quint32(Version) << d.documents << d.postings;
+    return stream.status() == QDataStream::Ok;
+}
+
+bool QuasselIndex::load(QIODevice* device)
+{
+    QDataStream stream(device);
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (magic != Magic || version != Version)
+        return false;
+
+    clear();
+    stream >> d.documents >> d.postings;
+    if (stream.status() != QDataStream::Ok) {
+        clear();
+        return false;
+    }
+    reduce();
+    return true;
+}
+
+QVector<MsgId> QuasselIndex::lookup(const QString& term) const
+{
+    // "foo" matches the token, "foo*" any token starting with it
+    QString token = term.toCaseFolded();
+    const bool prefix = token.endsWith('*');
+    if (prefix)
+        token.chop(1);
+    if (token.isEmpty())
+        return QVector<MsgId>();
+
+    if (!prefix)
+        return d.postings.value(token);
+
+    // the postings of all matching tokens are concatenated and sorted
+    // once, instead of merged pairwise for every token
+    QList<const QVector<MsgId>*> postings;
+    int count = 0;
+    QMap<QString, QVector<MsgId> >::const_iterator it = d.postings.lowerBound(token);
+    for (; it != d.postings.constEnd() && it.key().startsWith(token); ++it) {
+        postings += &it.value();
+        count += it.value().count();
+    }
+    if (postings.count() == 1)
+        return *postings.first();
+
+    QVector<MsgId> ids;
+    ids.reserve(count);
+    foreach (const QVector<MsgId>* ptr, postings)
+        ids += *ptr;
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void QuasselIndex::reduce()
+{
+    while (d.documents.count() > d.maxCount) {
+        d.documents.erase(d.documents.begin());
+        ++d.evicted;
+    }
+    if (d.evicted > d.maxCount / 4)
+        compact();
+}
+
+void QuasselIndex::compact()
+{
+    // older messages can be inserted after newer ones were evicted, so
+    // purge by membership instead of by id range
+    QMap<QString, QVector<MsgId> >::iterator it = d.postings.begin();
+    while (it != d.postings.end()) {
+        QVector<MsgId>& ids = it.value();
+        QVector<MsgId>::iterator end = ids.begin();
+        for (QVector<MsgId>::const_iterator id = ids.constBegin(); id != ids.constEnd(); ++id) {
+            if (d.documents.contains(*id))
+                *end++ = *id;
+        }
+        ids.erase(end, ids.end());
+        if (ids.isEmpty())
+            it = d.postings.erase(it);
+        else
+            ++it;
+    }
+    d.evicted = 0;
+}
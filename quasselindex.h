@@ -0,0 +1,76 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUASSELINDEX_H
+#define QUASSELINDEX_H
+
+#include <QMap>
+#include <QVector>
+#include <QStringList>
+#include "types.h"
+
+class QIODevice;
+
+class QuasselIndex
+{
+public:
+    enum { Magic = 0x51494458, Version = 1 }; // "QIDX"
+
+    struct Hit {
+        BufferId buffer;
+        MsgId msgId;
+    };
+
+    QuasselIndex();
+
+    int count() const;
+
+    int maximumCount() const;
+    void setMaximumCount(int count);
+
+    void insert(BufferId buffer, MsgId msgId, const QString& text);
+    QList<Hit> search(const QString& query, int limit = 50) const;
+    void clear();
+
+    bool save(QIODevice* device) const;
+    bool load(QIODevice* device);
+
+private:
+    QVector<MsgId> lookup(const QString& term) const;
+    void reduce();
+    void compact();
+
+    struct Private {
+        int maxCount;
+        int evicted;
+        QMap<MsgId, BufferId> documents; // oldest first
+        QMap<QString, QVector<MsgId> > postings; // token -> sorted msg ids
+    } d;
+};
+
+#endif // QUASSELINDEX_H
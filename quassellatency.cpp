@@ -0,0 +1,144 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quassellatency.h"
+#include <climits>
+
+// Round-trip samples in logarithmic buckets: constant memory per
+// connection, and percentiles within a factor of two of the actual
+// value (interpolated linearly inside the bucket).
+
+static int bucketIndex(int msecs)
+{
+    int bucket = 0;
+    while (msecs > 0 && bucket < QuasselLatency::BucketCount - 1) {
+        msecs >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+QuasselLatency::QuasselLatency(QObject* parent) : QObject(parent)
+{
+    d.threshold = 2000;
+    clear();
+}
+
+int QuasselLatency::count() const
+{
+    return d.count;
+}
+
+int QuasselLatency::last() const
+{
+    return d.last;
+}
+
+int QuasselLatency::minimum() const
+{
+    return d.min;
+}
+
+int QuasselLatency::maximum() const
+{
+    return d.max;
+}
+
+int QuasselLatency::percentile(int percent) const
+{
+    if (!d.count)
+        return -1;
+
+    const qint64 rank = (qint64(d.count) * qBound(0, percent, 100) + 99) / 100;
+    qint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        if (!d.buckets[i])
+            continue;
+        if (seen + d.buckets[i] >= rank) {
+            const int lower = i ? bucketLimit(i - 1) : 0;
+            const int upper = qMin(bucketLimit(i), d.max + 1);
+            // the rank-th of the bucket's samples, spread evenly over [lower, upper)
+            const int value = qMax(lower, lower + int((upper - lower) * (rank - seen) / d.buckets[i]) - 1);
+            return qBound(d.min, value, d.max);
+        }
+        seen += d.buckets[i];
+    }
+    return d.max;
+}
+
+int QuasselLatency::bucketCount(int bucket) const
+{
+    if (bucket < 0 || bucket >= BucketCount)
+        return 0;
+    return d.buckets[bucket];
+}
+
+int QuasselLatency::bucketLimit(int bucket)
+{
+    // exclusive upper limit of the bucket
+    if (bucket >= BucketCount - 1)
+        return INT_MAX;
+    return 1 << qMax(0, bucket);
+}
+
+int QuasselLatency::spikeThreshold() const
+{
+    return d.threshold;
+}
+
+void QuasselLatency::setSpikeThreshold(int msecs)
+{
+    d.threshold = msecs;
+}
+
+void QuasselLatency::clear()
+{
+    d.count = 0;
+    d.last = -1;
+    d.min = -1;
+    d.max = -1;
+    for (int i = 0; i < BucketCount; ++i)
+        d.buckets[i] = 0;
+}
+
+void QuasselLatency::addSample(int msecs)
+{
+    if (msecs < 0)
+        return;
+
+    ++d.buckets[bucketIndex(msecs)];
+    ++d.count;
+    d.last = msecs;
+    if (d.min == -1 || msecs < d.min)
+        d.min = msecs;
+    if (msecs > d.max)
+        d.max = msecs;
+
+    if (d.threshold > 0 && msecs >= d.threshold)
+        emit latencySpike(msecs);
+}
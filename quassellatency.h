@@ -0,0 +1,74 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUASSELLATENCY_H
+#define QUASSELLATENCY_H
+
+#include <QObject>
+
+class QuasselLatency : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum { BucketCount = 18 }; // [0,1), [1,2), [2,4), ..., [65536,inf) msecs
+
+    explicit QuasselLatency(QObject* parent = 0);
+
+    int count() const;
+    int last() const;
+    int minimum() const;
+    int maximum() const;
+    int percentile(int percent) const;
+
+    int bucketCount(int bucket) const;
+    static int bucketLimit(int bucket);
+
+    int spikeThreshold() const;
+    void setSpikeThreshold(int msecs);
+
+    void clear();
+
+public slots:
+    void addSample(int msecs);
+
+signals:
+    void latencySpike(int msecs);
+
+private:
+    struct Private {
+        int count;
+        int last;
+        int min;
+        int max;
+        int threshold;
+        int buckets[BucketCount];
+    } d;
+};
+
+#endif // QUASSELLATENCY_H
@@ -0,0 +1,164 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselmatcher.h"
+#include <QQueue>
+
+// Aho-Corasick automaton over case-folded UTF-16 code units: a single
+// pass over the text finds every occurrence of every pattern.
+
+QuasselMatcher::QuasselMatcher()
+{
+    d.words = false;
+    build();
+}
+
+QStringList QuasselMatcher::patterns() const
+{
+    return d.patterns;
+}
+
+void QuasselMatcher::setPatterns(const QStringList& patterns)
+{
+    d.patterns = patterns;
+    build();
+}
+
+bool QuasselMatcher::wholeWords() const
+{
+    return d.words;
+}
+
+void QuasselMatcher::setWholeWords(bool enabled)
+{
+    d.words = enabled;
+}
+
+bool QuasselMatcher::isEmpty() const
+{
+    return d.nodes.count() <= 1;
+}
+
+bool QuasselMatcher::matches(const QString& text) const
+{
+    return scan(text, 0);
+}
+
+QList<int> QuasselMatcher::match(const QString& text) const
+{
+    QList<int> matches;
+    scan(text, &matches);
+    return matches;
+}
+
+void QuasselMatcher::build()
+{
+    d.nodes.clear();
+    d.nodes.append(Node());
+
+    for (int p = 0; p < d.patterns.count(); ++p) {
+        const QString pattern = d.patterns.at(p).toCaseFolded();
+        if (pattern.isEmpty())
+            continue;
+        int state = 0;
+        foreach (const QChar& c, pattern) {
+            int next = d.nodes.at(state).edges.value(c.unicode(), -1);
+            if (next == -1) {
+                next = d.nodes.count();
+                d.nodes[state].edges.insert(c.unicode(), next);
+                d.nodes.append(Node());
+                d.nodes[next].depth = d.nodes.at(state).depth + 1;
+            }
+            state = next;
+        }
+        if (d.nodes.at(state).output == -1)
+            d.nodes[state].output = p;
+    }
+
+    // breadth first, so that fail links point to already finished nodes
+    QQueue<int> queue;
+    foreach (int child, d.nodes.at(0).edges)
+        queue.enqueue(child);
+    while (!queue.isEmpty()) {
+        const int state = queue.dequeue();
+        const QHash<ushort, int> edges = d.nodes.at(state).edges;
+        for (QHash<ushort, int>::const_iterator it = edges.constBegin(); it != edges.constEnd(); ++it) {
+            const int child = it.value();
+            int fail = d.nodes.at(state).fail;
+            while (fail > 0 && !d.nodes.at(fail).edges.contains(it.key()))
+                fail = d.nodes.at(fail).fail;
+            fail = d.nodes.at(fail).edges.value(it.key(), 0);
+            d.nodes[child].fail = fail;
+            d.nodes[child].next = d.nodes.at(fail).output != -1 ? fail : d.nodes.at(fail).next;
+            queue.enqueue(child);
+        }
+    }
+}
+
+int QuasselMatcher::step(int state, ushort c) const
+{
+    forever {
+        const int next = d.nodes.at(state).edges.value(c, -1);
+        if (next != -1)
+            return next;
+        if (state == 0)
+            return 0;
+        state = d.nodes.at(state).fail;
+    }
+}
+
+static bool isWordChar(const QString& text, int index)
+{
+    return index >= 0 && index < text.length() && text.at(index).isLetterOrNumber();
+}
+
+bool QuasselMatcher::scan(const QString& text, QList<int>* matches) const
+{
+    if (isEmpty())
+        return false;
+
+    bool found = false;
+    int state = 0;
+    const QString folded = text.toCaseFolded();
+    for (int i = 0; i < folded.length(); ++i) {
+        state = step(state, folded.at(i).unicode());
+        for (int n = state; n > 0; n = d.nodes.at(n).next) {
+            const int output = d.nodes.at(n).output;
+            if (output == -1)
+                continue;
+            if (d.words && (isWordChar(folded, i - d.nodes.at(n).depth) || isWordChar(folded, i + 1)))
+                continue;
+            if (!matches)
+                return true;
+            if (!matches->contains(output))
+                *matches += output;
+            found = true;
+        }
+    }
+    return found;
+}
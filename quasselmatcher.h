@@ -0,0 +1,72 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUASSELMATCHER_H
+#define QUASSELMATCHER_H
+
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+
+class QuasselMatcher
+{
+public:
+    QuasselMatcher();
+
+    QStringList patterns() const;
+    void setPatterns(const QStringList& patterns);
+
+    bool wholeWords() const;
+    void setWholeWords(bool enabled);
+
+    bool isEmpty() const;
+    bool matches(const QString& text) const;
+    QList<int> match(const QString& text) const;
+
+private:
+    void build();
+    int step(int state, ushort c) const;
+    bool scan(const QString& text, QList<int>* matches) const;
+
+    struct Node {
+        Node() : depth(0), fail(0), output(-1), next(-1) { }
+        QHash<ushort, int> edges;
+        int depth;
+        int fail;
+        int output; // pattern index ending here, -1 for none
+        int next; // next node with output along the fail chain
+    };
+
+    struct Private {
+        bool words;
+        QStringList patterns;
+        QVector<Node> nodes;
+    } d;
+};
+
+#endif // QUASSELMATCHER_H
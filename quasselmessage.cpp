@@ -27,38 +27,119 @@
 */
 
 #include "quasselmessage.h"
+#include "quasseldebug.h"
 #include "message.h"
 #include <IrcConnection>
 #include <IrcMessage>
+#include <QCoreApplication>
+#include <QBasicTimer>
+#include <QTimerEvent>
+#include <QPointer>
+#include <QHash>
 
 IRC_USE_NAMESPACE
 
 namespace Quassel
 {
-    static QString messageCommand(Message::Type type)
+    typedef IrcMessage* (*MessageFactory)(IrcConnection* connection);
+
+    template <typename T>
+    static IrcMessage* createMessage(IrcConnection* connection)
     {
-        switch (type)
+        return new T(connection);
+    }
+
+    struct MessageInfo
+    {
+        Message::Type type;
+        const char* command;
+        MessageFactory factory;
+    };
+
+    // the message types that map to IRC, constructed directly instead of
+    // letting IrcMessage::fromParameters() look the type up by command
+    static const MessageInfo messageTable[] = {
+        { Message::Plain,        "PRIVMSG", &createMessage<IrcPrivateMessage> },
+        { Message::Notice,       "NOTICE",  &createMessage<IrcNoticeMessage> },
+        { Message::Action,       "PRIVMSG", &createMessage<IrcPrivateMessage> },
+        { Message::Nick,         "NICK",    &createMessage<IrcNickMessage> },
+        { Message::Mode,         "MODE",    &createMessage<IrcModeMessage> },
+        { Message::Join,         "JOIN",    &createMessage<IrcJoinMessage> },
+        { Message::Part,         "PART",    &createMessage<IrcPartMessage> },
+        { Message::Quit,         "QUIT",    &createMessage<IrcQuitMessage> },
+        { Message::Kick,         "KICK",    &createMessage<IrcKickMessage> },
+        { Message::Server,       "001",     &createMessage<IrcNumericMessage> },
+        { Message::Error,        "NOTICE",  &createMessage<IrcNoticeMessage> },
+        { Message::NetsplitQuit, "QUIT",    &createMessage<IrcQuitMessage> },
+        { Message::Invite,       "INVITE",  &createMessage<IrcInviteMessage> }
+    };
+
+    static const MessageInfo* messageInfo(Message::Type type)
+    {
+        for (uint i = 0; i < sizeof(messageTable) / sizeof(messageTable[0]); ++i) {
+            if (messageTable[i].type == type)
+                return &messageTable[i];
+        }
+        return 0;
+    }
+
+    // a summary per interval instead of a line per message, backlog
+    // replays easily contain thousands of these
+    class UnhandledSummary : public QObject
+    {
+    public:
+        explicit UnhandledSummary(QObject* parent) : QObject(parent) { }
+        ~UnhandledSummary() { flush(); }
+
+        void add(int type)
+        {
+            static const int SummaryMsecs = 10000;
+            ++counts[type];
+            if (!timer.isActive())
+                timer.start(SummaryMsecs, this);
+        }
+
+    protected:
+        void timerEvent(QTimerEvent* event)
+        {
+            if (event->timerId() != timer.timerId())
+                return;
+            timer.stop();
+            flush();
+        }
+
+    private:
+        void flush()
         {
-        case Message::Plain:        return QLatin1String("PRIVMSG");
-        case Message::Notice:       return QLatin1String("NOTICE");
-        case Message::Action:       return QLatin1String("PRIVMSG");
-        case Message::Nick:         return QLatin1String("NICK");
-        case Message::Mode:         return QLatin1String("MODE");
-        case Message::Join:         return QLatin1String("JOIN");
-        case Message::Part:         return QLatin1String("PART");
-        case Message::Quit:         return QLatin1String("QUIT");
-        case Message::Kick:         return QLatin1String("KICK");
-        case Message::Kill:         return QString();
-        case Message::Server:       return QString();
-        case Message::Info:         return QString();
-        case Message::Error:        return QString();
-        case Message::DayChange:    return QString();
-        case Message::Topic:        return QLatin1String("TOPIC");
-        case Message::NetsplitJoin: return QLatin1String("JOIN");
-        case Message::NetsplitQuit: return QLatin1String("QUIT");
-        case Message::Invite:       return QLatin1String("INVITE");
-        default:                    return QString();
+            QHash<int, int>::const_iterator it;
+            for (it = counts.constBegin(); it != counts.constEnd(); ++it)
+                qQuasselDebug() << "Quassel::convertMessage(): unhandled type" << QString::number(it.key(), 16) << "x" << it.value();
+            counts.clear();
         }
+
+        QHash<int, int> counts;
+        QBasicTimer timer;
+    };
+
+    static void unhandledMessage(const Message& message)
+    {
+        if (!qQuasselDebugEnabled())
+            return;
+
+        // owned by the application, so that the last batch is logged on exit
+        static QPointer<UnhandledSummary> summary;
+        if (!summary)
+            summary = new UnhandledSummary(QCoreApplication::instance());
+        summary->add(message.type());
+    }
+
+    static IrcMessage* createMessage(const MessageInfo* info, const QString& prefix, const QStringList& params, IrcConnection* connection)
+    {
+        IrcMessage* msg = info->factory(connection);
+        msg->setPrefix(prefix);
+        msg->setCommand(QString::fromLatin1(info->command));
+        msg->setParameters(params);
+        return msg;
     }
 
     QList<IrcMessage*> convertMessage(const Message& message, IrcConnection* connection)
@@ -67,13 +148,23 @@ namespace Quassel
         if (message.flags() & Message::Self)
             return msgs;
 
+        // There's no sane way to parse the topic from a _localized_ message that could be:
+        // - "Topic for #channel is "topic"
+        // - "Topic set by nick!user@host on ..."
+        // - "Homepage for #channel is ..."
+        // - "nick has changed topic for #channel to: "topic""
+        if (message.type() == Message::Topic)
+            return msgs;
+
+        const MessageInfo* info = messageInfo(message.type());
+        if (!info) {
+            // TODO: Kill, Info, DayChange, NetsplitJoin
+            unhandledMessage(message);
+            return msgs;
+        }
+
         QString buffer = message.bufferInfo().bufferName();
-        QString command = messageCommand(message.type());
         QString contents = message.contents();
-        QStringList split;
-        if (message.type() == Message::Mode || message.type() == Message::Kick ||
-                message.type() == Message::Topic || message.type() == Message::Invite)
-            split = contents.split(' ', QString::SkipEmptyParts);
 
         switch (message.type())
         {
@@ -84,46 +175,38 @@ namespace Quassel
         case Message::Notice:
         case Message::Join:
         case Message::Part:
-            msgs += IrcMessage::fromParameters(message.sender(), command, QStringList() << buffer << contents, connection);
+            msgs += createMessage(info, message.sender(), QStringList() << buffer << contents, connection);
             break;
         case Message::Nick:
         case Message::Quit:
-            msgs += IrcMessage::fromParameters(message.sender(), command, QStringList() << contents, connection);
+            msgs += createMessage(info, message.sender(), QStringList() << contents, connection);
             break;
         case Message::Mode:
-            msgs += IrcMessage::fromParameters(message.sender(), command, split, connection);
+            msgs += createMessage(info, message.sender(), contents.split(' ', QString::SkipEmptyParts), connection);
             break;
-        case Message::Kick:
-            msgs += IrcMessage::fromParameters(message.sender(), command, QStringList() << buffer << split.value(0) << QStringList(split.mid(1)).join(" "), connection);
+        case Message::Kick: {
+            QString reason = contents.section(' ', 1, -1, QString::SectionSkipEmpty);
+            msgs += createMessage(info, message.sender(), QStringList() << buffer << contents.section(' ', 0, 0, QString::SectionSkipEmpty) << reason, connection);
             break;
-        case Message::Topic:
-            // There's no sane way to parse the topic from a _localized_ message that could be:
-            // - "Topic for #channel is "topic"
-            // - "Topic set by nick!user@host on ..."
-            // - "Homepage for #channel is ..."
-            // - "nick has changed topic for #channel to: "topic""
-            break;
-        case Message::Invite:
-            msgs += IrcMessage::fromParameters(split.first(), command, QStringList() << connection->nickName() << split.last(), connection);
+        }
+        case Message::Invite: {
+            QString channel = contents.section(' ', -1, -1, QString::SectionSkipEmpty);
+            msgs += createMessage(info, contents.section(' ', 0, 0, QString::SectionSkipEmpty), QStringList() << connection->nickName() << channel, connection);
             break;
+        }
         case Message::Server:
-            msgs += IrcMessage::fromParameters(message.sender(), QString::number(Irc::RPL_WELCOME), QStringList() << "*" << message.contents(), connection);
+            msgs += createMessage(info, message.sender(), QStringList() << "*" << contents, connection);
             break;
         case Message::Error:
-            msgs += IrcMessage::fromParameters("ERROR", "NOTICE", QStringList() << "*" << contents, connection);
+            msgs += createMessage(info, "ERROR", QStringList() << "*" << contents, connection);
             break;
-        case Message::NetsplitQuit:
-            split = contents.split("#:#");
-            for (int i = 0; i < split.count() - i; ++i)
-                msgs += IrcMessage::fromParameters(split.at(i), command, QStringList() << split.last(), connection);
+        case Message::NetsplitQuit: {
+            QStringList split = contents.split("#:#");
+            for (int i = 0; i < split.count() - 1; ++i)
+                msgs += createMessage(info, split.at(i), QStringList() << split.last(), connection);
             break;
-            // TODO:
-        case Message::Kill:
-        case Message::Info:
-        case Message::DayChange:
-        case Message::NetsplitJoin:
+        }
         default:
-            qDebug() << "Quassel::convertMessage(): TODO:" << QString::number(message.type(), 16) << message.sender() << message.contents();
             break;
         }
 
@@ -29,7 +29,16 @@
 #include "quasselprotocol.h"
 #include "quasselauthhandler.h"
 #include "quasselmessage.h"
+#include "quasselqueue.h"
+#include "quasselscrollback.h"
+#include "quasselsession.h"
+#include "quasselsocket.h"
+#include "quasselactivity.h"
+#include "quasselcapture.h"
+#include "quasselindex.h"
+#include "quassellatency.h"
 #include "backlogmanager.h"
+#include "buffersyncer.h"
 #include "quasselbacklog.h"
 #include "quasseltypes.h"
 #include "remotepeer.h"
@@ -37,23 +46,378 @@
 #include "protocol.h"
 #include "network.h"
 #include "message.h"
+#include <QFileInfo>
 
 IRC_USE_NAMESPACE
 
+static const int BackgroundMsecs = 5000; // wakeup interval in background mode
+
 QuasselProtocol::QuasselProtocol(IrcConnection* connection) : IrcProtocol(connection)
 {
+    d.early = false;
+    d.threaded = false;
+    d.warm = false;
+    d.background = false;
+    d.heartBeat = 30;
+    d.activityInterval = 0;
+    d.sync = SyncAll;
+    d.refresh = 0;
     d.proxy = 0;
+    d.syncer = 0;
+    d.socket = 0;
+    d.capture = 0;
+    d.captures = 0;
+    d.index = 0;
     d.handler = 0;
     d.network = 0;
 
     Quassel::registerTypes();
 
+    d.highlightMatcher.setWholeWords(true);
+    connect(connection, SIGNAL(nickNameChanged(QString)), this, SLOT(updateHighlights()));
+    updateHighlights();
+
+    d.queue = new QuasselQueue(this);
+    connect(d.queue, SIGNAL(messageDequeued(Message)), this, SLOT(deliverMessage(Message)));
+    connect(d.queue, SIGNAL(congestedChanged(bool)), this, SLOT(pauseReading(bool)));
+
     d.backlog = new QuasselBacklog(this);
+    d.backlog->setQueue(d.queue);
     connect(d.backlog, SIGNAL(messageReceived(Message)), this, SLOT(receiveMessage(Message)));
+    connect(d.backlog, SIGNAL(pageReceived(BufferId,MsgId,MsgId)), this, SLOT(receivePage(BufferId,MsgId,MsgId)));
+
+    d.scrollback = new QuasselScrollback;
+    d.activity = new QuasselActivity(this);
+    d.latency = new QuasselLatency(this);
+    d.session = new QuasselSession(connection, this);
 }
 
 QuasselProtocol::~QuasselProtocol()
 {
+    delete d.index;
+    delete d.scrollback;
+}
+
+bool QuasselProtocol::earlyAvailability() const
+{
+    return d.early;
+}
+
+void QuasselProtocol::setEarlyAvailability(bool enabled)
+{
+    d.early = enabled;
+}
+
+bool QuasselProtocol::isThreaded() const
+{
+    return d.threaded;
+}
+
+void QuasselProtocol::setThreaded(bool threaded)
+{
+    d.threaded = threaded;
+}
+
+bool QuasselProtocol::isBackground() const
+{
+    return d.background;
+}
+
+void QuasselProtocol::setBackground(bool background)
+{
+    if (d.background == background)
+        return;
+
+    // in the background, counters and highlights stay up to date while
+    // ordinary messages, joined channels and topic updates wait for the
+    // foreground
+    d.background = background;
+    if (background) {
+        d.activityInterval = d.activity->interval();
+        d.activity->setInterval(BackgroundMsecs);
+        d.queue->setInterval(BackgroundMsecs);
+        d.queue->setDeliveryPriority(QuasselQueue::HighPriority);
+    } else {
+        d.activity->setInterval(d.activityInterval);
+        d.queue->setInterval(0);
+        d.queue->setDeliveryPriority(QuasselQueue::LowPriority);
+
+        foreach (const QString& name, d.deferredChannels) {
+            IrcChannel* channel = d.network ? d.network->ircChannel(name) : 0;
+            if (channel)
+                announceChannel(channel);
+        }
+        d.deferredChannels.clear();
+        foreach (const QString& name, d.deferred) {
+            IrcChannel* channel = d.network ? d.network->ircChannel(name) : 0;
+            if (channel)
+                updateTopic(channel);
+        }
+        d.deferred.clear();
+    }
+}
+
+QuasselProtocol::SyncFlags QuasselProtocol::syncFlags() const
+{
+    return d.sync;
+}
+
+static QSet<QByteArray> syncFilter(QuasselProtocol::SyncFlags flags)
+{
+    // channel membership is always synchronized, nick changes and parts
+    // depend on it. the details are not used by the protocol itself, but
+    // may be by users of network()
+    static const char* const details[] = {
+        "IrcUser::setRealName", "IrcUser::setAccount", "IrcUser::setAway", "IrcUser::setAwayMessage",
+        "IrcUser::setIdleTime", "IrcUser::setLoginTime", "IrcUser::setServer", "IrcUser::setIrcOperator",
+        "IrcUser::setLastAwayMessage", "IrcUser::setWhoisServiceReply", "IrcUser::setSuserHost",
+        "IrcUser::setEncrypted", "IrcUser::setUserModes", "IrcUser::addUserModes", "IrcUser::removeUserModes",
+        "IrcChannel::setPassword", "IrcChannel::setEncrypted", "IrcChannel::addChannelMode", "IrcChannel::removeChannelMode"
+    };
+
+    QSet<QByteArray> calls;
+    if (!(flags & QuasselProtocol::SyncDetails)) {
+        for (uint i = 0; i < sizeof(details) / sizeof(details[0]); ++i)
+            calls.insert(details[i]);
+    }
+    if (!(flags & QuasselProtocol::SyncTopics))
+        calls.insert("IrcChannel::setTopic");
+    if (!(flags & QuasselProtocol::SyncUsers) || !(flags & QuasselProtocol::SyncUserModes)) {
+        calls.insert("IrcChannel::setUserModes");
+        calls.insert("IrcChannel::addUserMode");
+        calls.insert("IrcChannel::removeUserMode");
+    }
+    return calls;
+}
+
+void QuasselProtocol::setSyncFlags(SyncFlags flags)
+{
+    // the core keeps sending all updates, the flags control which ones are
+    // dropped before being dispatched and turned into IRC messages
+    const SyncFlags enabled = flags & ~d.sync;
+    const SyncFlags disabled = d.sync & ~flags;
+    const bool filtered = d.socket && !d.socket->syncFilter().isEmpty();
+    if (enabled && filtered && d.network && d.network->isInitialized()) {
+        // what was dropped meanwhile is stale, so the network is synchronized
+        // again and reconciled, like on a warm reconnect, against what has
+        // been emitted with the previous flags
+        saveChannels();
+        foreach (const ChannelState& state, d.snapshot)
+            d.announced.insert(state.name.toLower());
+        d.refresh |= enabled;
+        d.sync = flags;
+        updateSyncFilter();
+        synchronizeNetwork(d.network->networkId());
+        return;
+    }
+
+    d.sync = flags;
+    updateSyncFilter();
+    if ((enabled | disabled) & (SyncUsers | SyncUserModes))
+        d.snapshot.clear();
+    if ((enabled | disabled) && d.network) {
+        // unfiltered, the channels are up to date
+        foreach (const QString& name, d.network->channels()) {
+            IrcChannel* channel = d.network->ircChannel(name);
+            if (!channel || !channel->isInitialized() || d.deferredChannels.contains(name))
+                continue;
+            if (disabled & SyncTopics)
+                disconnect(channel, SIGNAL(topicSet(QString)), this, SLOT(updateTopic()));
+            if (enabled & SyncTopics) {
+                updateTopic(channel);
+                connect(channel, SIGNAL(topicSet(QString)), this, SLOT(updateTopic()), Qt::UniqueConnection);
+            }
+            if (enabled & (SyncUsers | SyncUserModes) && flags & SyncUsers)
+                updateUsers(channel);
+        }
+    }
+}
+
+bool QuasselProtocol::warmReconnect() const
+{
+    return d.warm;
+}
+
+void QuasselProtocol::setWarmReconnect(bool enabled)
+{
+    d.warm = enabled;
+    if (!enabled)
+        d.snapshot.clear();
+}
+
+QString QuasselProtocol::captureFile() const
+{
+    return d.captureFile;
+}
+
+void QuasselProtocol::setCaptureFile(const QString& fileName)
+{
+    d.captureFile = fileName;
+    d.captures = 0;
+}
+
+QStringList QuasselProtocol::highlights() const
+{
+    return d.highlights;
+}
+
+void QuasselProtocol::setHighlights(const QStringList& highlights)
+{
+    d.highlights = highlights;
+    updateHighlights();
+}
+
+QStringList QuasselProtocol::ignores() const
+{
+    return d.ignores;
+}
+
+void QuasselProtocol::setIgnores(const QStringList& ignores)
+{
+    // a plain pattern ignores a nick, one with wildcards or a user/host
+    // part is matched against the whole nick!user@host mask. the longest
+    // literal part of each mask goes into a matcher, so that only the
+    // masks whose literal occurs in the sender are tried
+    d.ignores = ignores;
+    d.ignoredNicks.clear();
+    d.ignoredMasks.clear();
+    d.ignoredWildcards.clear();
+    QStringList literals;
+    foreach (const QString& ignore, ignores) {
+        if (ignore.isEmpty())
+            continue;
+        if (!ignore.contains(QRegExp("[!@*?]"))) {
+            d.ignoredNicks.insert(ignore.toCaseFolded());
+            continue;
+        }
+
+        const QRegExp mask(ignore, Qt::CaseInsensitive, QRegExp::Wildcard);
+        // character sets have no literal part that must occur
+        QString literal;
+        if (!ignore.contains('[')) {
+            foreach (const QString& part, ignore.split(QRegExp("[*?]"), QString::SkipEmptyParts)) {
+                if (part.length() > literal.length())
+                    literal = part;
+            }
+        }
+        literal = literal.toCaseFolded();
+        if (literal.isEmpty()) {
+            d.ignoredWildcards += mask;
+            continue;
+        }
+        int index = literals.indexOf(literal);
+        if (index == -1) {
+            index = literals.count();
+            literals += literal;
+            d.ignoredMasks += QList<QRegExp>();
+        }
+        d.ignoredMasks[index] += mask;
+    }
+    d.ignoreMatcher.setPatterns(literals);
+}
+
+bool QuasselProtocol::isIndexEnabled() const
+{
+    return d.index;
+}
+
+void QuasselProtocol::setIndexEnabled(bool enabled)
+{
+    if (enabled && !d.index) {
+        d.index = new QuasselIndex;
+    } else if (!enabled && d.index) {
+        delete d.index;
+        d.index = 0;
+    }
+}
+
+QuasselIndex* QuasselProtocol::index() const
+{
+    return d.index;
+}
+
+int QuasselProtocol::heartBeatInterval() const
+{
+    return d.heartBeat;
+}
+
+void QuasselProtocol::setHeartBeatInterval(int secs)
+{
+    d.heartBeat = secs;
+    if (d.proxy)
+        d.proxy->setHeartBeatInterval(secs);
+}
+
+QuasselScrollback* QuasselProtocol::scrollback() const
+{
+    return d.scrollback;
+}
+
+void QuasselProtocol::fetchOlder(BufferId buffer, MsgId before, int count)
+{
+    // serve the run of the scrollback that directly precedes the anchor and
+    // ask the core for the rest, anchored at the oldest message served
+    QList<Message> messages = d.scrollback->messages(buffer, before, count);
+    foreach (const Message& message, messages)
+        deliverMessage(message);
+
+    if (messages.count() < count && d.proxy && d.network) {
+        MsgId last = before.isValid() ? before : MsgId(-1);
+        if (!messages.isEmpty())
+            last = messages.first().msgId();
+        d.backlog->fetchBacklog(buffer, -1, last, count - messages.count());
+    }
+}
+
+void QuasselProtocol::fetchOlder(const QString& buffer, MsgId before, int count)
+{
+    BufferInfo info = findBuffer(buffer);
+    if (info.bufferId().isValid())
+        fetchOlder(info.bufferId(), before, count);
+}
+
+Network* QuasselProtocol::network() const
+{
+    return d.network;
+}
+
+QuasselQueue* QuasselProtocol::queue() const
+{
+    return d.queue;
+}
+
+QuasselActivity* QuasselProtocol::activity() const
+{
+    return d.activity;
+}
+
+void QuasselProtocol::markAsRead(const QString& buffer)
+{
+    const BufferId id = findBuffer(buffer).bufferId();
+    const MsgId msgId = d.activity->lastMsgId(id);
+    d.activity->markAsRead(id);
+    if (d.syncer && msgId.isValid())
+        d.syncer->requestSetLastSeenMsg(id, msgId);
+}
+
+QuasselLatency* QuasselProtocol::latency() const
+{
+    return d.latency;
+}
+
+QuasselSession* QuasselProtocol::session() const
+{
+    return d.session;
+}
+
+QuasselBacklog* QuasselProtocol::backlog() const
+{
+    return d.backlog;
+}
+
+QuasselSocket* QuasselProtocol::compressedSocket() const
+{
+    return d.socket;
 }
 
 void QuasselProtocol::open()
@@ -61,11 +425,32 @@ void QuasselProtocol::open()
     if (d.handler)
         return;
 
+    // the socket may have been replaced since the previous connection
+    d.session->attach();
+
     d.proxy = new SignalProxy(this);
+    d.proxy->setHeartBeatInterval(d.heartBeat);
     d.proxy->attachSignal(this, SIGNAL(sendInput(BufferInfo,QString)));
     d.proxy->attachSlot(SIGNAL(displayMsg(Message)), this, SLOT(receiveMessage(Message)));
 
     d.handler = new QuasselAuthHandler(connection());
+    d.handler->setThreaded(d.threaded);
+    if (!d.captureFile.isEmpty()) {
+        // every reconnect gets its own file, "session.qcap" followed by
+        // "session-2.qcap" and so on, so that a failed session is kept
+        QString fileName = d.captureFile;
+        if (d.captures++) {
+            const QFileInfo info(fileName);
+            const QString suffix = info.suffix().isEmpty() ? QString() : "." + info.suffix();
+            fileName.chop(suffix.length());
+            fileName += QString("-%1").arg(d.captures) + suffix;
+        }
+        d.capture = new QuasselCapture(fileName, this);
+        if (d.capture->open())
+            d.handler->setCapture(d.capture);
+        else
+            receiveInfo(Irc::RPL_MYINFO, QString("Cannot write capture: %1").arg(fileName));
+    }
     connect(d.handler, SIGNAL(clientDenied(Protocol::ClientDenied)), this, SLOT(clientDenied(Protocol::ClientDenied)));
     connect(d.handler, SIGNAL(clientRegistered(Protocol::ClientRegistered)), this, SLOT(clientRegistered(Protocol::ClientRegistered)));
     connect(d.handler, SIGNAL(loginFailed(Protocol::LoginFailed)), this, SLOT(loginFailed(Protocol::LoginFailed)));
@@ -82,15 +467,33 @@ void QuasselProtocol::close()
     if (d.proxy) {
         d.proxy->deleteLater();
         d.proxy = 0;
+        d.syncer = 0;
+        d.socket = 0;
     }
     if (d.handler) {
         d.handler->deleteLater();
         d.handler = 0;
     }
+    if (d.capture) {
+        d.capture->close();
+        d.capture->deleteLater();
+        d.capture = 0;
+    }
     if (d.network) {
+        if (d.warm)
+            saveChannels();
         d.network->deleteLater();
         d.network = 0;
     }
+    d.announced.clear();
+    d.deferred.clear();
+    d.deferredChannels.clear();
+    d.refresh = 0;
+    d.queue->clear();
+    d.backlog->clear();
+    d.scrollback->interrupt();
+    d.activity->restart();
+    d.session->attach();
 }
 
 void QuasselProtocol::read()
@@ -136,10 +539,30 @@ bool QuasselProtocol::write(const QByteArray& data)
     return false;
 }
 
-void QuasselProtocol::initNetwork()
+void QuasselProtocol::initBuffers()
 {
+    // announce the buffers known from the session state right away,
+    // channel state gets reconciled in initNetwork() once synchronized
     setStatus(IrcConnection::Connected);
-    receiveInfo(Irc::RPL_MYINFO, "Done");
+
+    foreach (const BufferInfo& buffer, d.buffers) {
+        if (buffer.type() == BufferInfo::ChannelBuffer) {
+            IrcMessage* msg = IrcMessage::fromParameters(prefix(), "JOIN", QStringList() << buffer.bufferName(), connection());
+            IrcProtocol::receiveMessage(msg);
+            d.announced.insert(buffer.bufferName().toLower());
+        }
+    }
+
+    requestBacklog();
+}
+
+void QuasselProtocol::initNetwork()
+{
+    const bool resync = d.refresh;
+    if (!d.early && !resync)
+        setStatus(IrcConnection::Connected);
+    if (!resync)
+        receiveInfo(Irc::RPL_MYINFO, "Done");
 
     QHash<QString, QString> info;
     info.insert("NETWORK", d.network->support("NETWORK"));
@@ -148,13 +571,31 @@ void QuasselProtocol::initNetwork()
     // TODO: ...
     setInfo(info);
 
+    // part the announced and previously joined channels that are no longer joined
+    QHash<QString, QString> stale;
+    foreach (const QString& name, d.announced)
+        stale.insert(name, findBuffer(name).bufferName());
+    foreach (const ChannelState& channel, d.snapshot)
+        stale.insert(channel.name.toLower(), channel.name);
+    foreach (const QString& name, d.network->channels())
+        stale.remove(name.toLower());
+    foreach (const QString& name, stale) {
+        IrcMessage* msg = IrcMessage::fromParameters(prefix(), "PART", QStringList() << name, connection());
+        IrcProtocol::receiveMessage(msg);
+    }
+    foreach (const QString& name, stale.keys()) {
+        d.announced.remove(name);
+        d.snapshot.remove(name);
+    }
+    if (d.snapshot.isEmpty())
+        d.refresh = 0;
+
     foreach (const QString& name, d.network->channels())
         addChannel(d.network->ircChannel(name));
     connect(d.network, SIGNAL(ircChannelAdded(IrcChannel*)), SLOT(addChannel(IrcChannel*)));
 
-    d.proxy->synchronize(d.backlog);
-    foreach (const BufferInfo& buffer, d.buffers)
-        d.backlog->requestBacklog(buffer.bufferId(), -1, -1, 100); // TODO: limit (100)
+    if (!d.early && !resync)
+        requestBacklog();
 }
 
 void QuasselProtocol::addChannel(IrcChannel* channel)
@@ -170,14 +611,40 @@ void QuasselProtocol::initChannel(IrcChannel* channel)
     if (!channel)
         channel = qobject_cast<IrcChannel*>(sender());
 
-    if (channel) {
+    if (channel && d.background)
+        d.deferredChannels.insert(channel->name());
+    else if (channel)
+        announceChannel(channel);
+}
+
+void QuasselProtocol::announceChannel(IrcChannel* channel)
+{
+    d.deferredChannels.remove(channel->name());
+    const QString key = channel->name().toLower();
+    if (!d.announced.remove(key)) {
         IrcMessage* msg = IrcMessage::fromParameters(prefix(), "JOIN", QStringList() << channel->name(), connection());
         IrcProtocol::receiveMessage(msg);
+    }
 
-        updateTopic(channel);
-        updateUsers(channel);
-        connect(channel, SIGNAL(topicSet(QString)), this, SLOT(updateTopic()));
+    if (d.snapshot.contains(key)) {
+        // warm reconnect: only emit what changed while disconnected
+        ChannelState previous = d.snapshot.take(key);
+        if (d.sync & SyncTopics && (d.refresh & SyncTopics || channel->topic() != previous.topic))
+            updateTopic(channel);
+        if (d.sync & SyncUsers && d.refresh & SyncUsers)
+            updateUsers(channel);
+        else if (d.sync & SyncUsers)
+            updateMembers(channel, previous);
+        if (d.snapshot.isEmpty())
+            d.refresh = 0;
+    } else {
+        if (d.sync & SyncTopics)
+            updateTopic(channel);
+        if (d.sync & SyncUsers)
+            updateUsers(channel);
     }
+    if (d.sync & SyncTopics)
+        connect(channel, SIGNAL(topicSet(QString)), this, SLOT(updateTopic()), Qt::UniqueConnection);
 }
 
 void QuasselProtocol::updateTopic(IrcChannel* channel)
@@ -185,7 +652,9 @@ void QuasselProtocol::updateTopic(IrcChannel* channel)
     if (!channel)
         channel = qobject_cast<IrcChannel*>(sender());
 
-    if (channel) {
+    if (channel && d.background) {
+        d.deferred.insert(channel->name());
+    } else if (channel) {
         IrcMessage* msg = 0;
         if (!channel->topic().isEmpty())
             msg = IrcMessage::fromParameters(prefix(), QString::number(Irc::RPL_TOPIC), QStringList() << connection()->nickName() << channel->name() << channel->topic(), connection());
@@ -200,12 +669,12 @@ void QuasselProtocol::updateUsers(IrcChannel* channel)
     if (channel) {
         QStringList users;
         Network* network = channel->network();
-        foreach (IrcUser* user, channel->ircUsers()) {
-            QString nick = user->nick();
-            QString prefix = channel->userModes(nick);
+        QHash<QString, QString> modes = channelState(channel).users;
+        for (QHash<QString, QString>::const_iterator it = modes.constBegin(); it != modes.constEnd(); ++it) {
+            QString prefix = it.value();
             if (!prefix.isEmpty())
                 prefix = network->modeToPrefix(prefix);
-            users += prefix + nick;
+            users += prefix + it.key();
         }
         IrcMessage* msg = new IrcNamesMessage(connection());
         msg->setPrefix(prefix());
@@ -215,19 +684,151 @@ void QuasselProtocol::updateUsers(IrcChannel* channel)
     }
 }
 
+void QuasselProtocol::updateMembers(IrcChannel* channel, const ChannelState& previous)
+{
+    const ChannelState current = channelState(channel);
+
+    QStringList joined, parted, changed;
+    for (QHash<QString, QString>::const_iterator it = current.users.constBegin(); it != current.users.constEnd(); ++it) {
+        if (!previous.users.contains(it.key()))
+            joined += it.key();
+        else if (previous.users.value(it.key()) != it.value())
+            changed += it.key();
+    }
+    foreach (const QString& nick, previous.users.keys()) {
+        if (!current.users.contains(nick))
+            parted += nick;
+    }
+
+    // rebuilding the whole list is cheaper than replaying a major change
+    if (2 * (joined.count() + parted.count() + changed.count()) > current.users.count()) {
+        updateUsers(channel);
+        return;
+    }
+
+    foreach (const QString& nick, parted)
+        IrcProtocol::receiveMessage(IrcMessage::fromParameters(nick, "PART", QStringList() << channel->name(), connection()));
+    foreach (const QString& nick, joined)
+        IrcProtocol::receiveMessage(IrcMessage::fromParameters(nick, "JOIN", QStringList() << channel->name(), connection()));
+
+    foreach (const QString& nick, joined + changed) {
+        const QString before = previous.users.value(nick);
+        const QString after = current.users.value(nick);
+        QString removed, added;
+        foreach (const QChar& mode, before) {
+            if (!after.contains(mode))
+                removed += mode;
+        }
+        foreach (const QChar& mode, after) {
+            if (!before.contains(mode))
+                added += mode;
+        }
+        QString modes;
+        if (!removed.isEmpty())
+            modes += "-" + removed;
+        if (!added.isEmpty())
+            modes += "+" + added;
+        if (!modes.isEmpty()) {
+            QStringList params = QStringList() << channel->name() << modes;
+            for (int i = 0; i < removed.length() + added.length(); ++i)
+                params += nick;
+            IrcProtocol::receiveMessage(IrcMessage::fromParameters(prefix(), "MODE", params, connection()));
+        }
+    }
+}
+
+static QuasselQueue::Priority messagePriority(const Message& message)
+{
+    switch (message.type()) {
+    case Message::Nick:
+    case Message::Join:
+    case Message::Part:
+    case Message::Quit:
+    case Message::NetsplitJoin:
+    case Message::NetsplitQuit:
+        return QuasselQueue::LowPriority;
+    default:
+        break;
+    }
+
+    if (message.bufferInfo().type() == BufferInfo::QueryBuffer || message.flags() & Message::Highlight)
+        return QuasselQueue::HighPriority;
+    return QuasselQueue::NormalPriority;
+}
+
+static bool isSearchable(const Message& message)
+{
+    return message.type() == Message::Plain || message.type() == Message::Notice || message.type() == Message::Action;
+}
+
+static bool isHighlightable(const Message& message)
+{
+    return !(message.flags() & Message::Self) && isSearchable(message);
+}
+
 void QuasselProtocol::receiveMessage(const Message& message)
 {
     BufferInfo buffer = message.bufferInfo();
     if (buffer.networkId() == d.network->networkId()) {
         d.buffers.insert(buffer.bufferName(), buffer);
-
-        QList<IrcMessage*> msgs = Quassel::convertMessage(message, connection());
-        foreach (IrcMessage* msg, msgs)
-            IrcProtocol::receiveMessage(msg);
         d.lastMsg = message.msgId();
+
+        // match before anything gets queued or converted
+        if (!(message.flags() & Message::Self) && isIgnored(message.sender()))
+            return;
+        Message msg(message);
+        if (isHighlightable(msg) && d.highlightMatcher.matches(msg.contents()))
+            msg.setFlags(msg.flags() | Message::Highlight);
+        if (d.index && isSearchable(msg))
+            d.index->insert(buffer.bufferId(), msg.msgId(), msg.contents());
+        d.activity->update(msg);
+        d.scrollback->insert(msg);
+
+        d.queue->enqueue(msg, messagePriority(msg));
+    }
+}
+
+void QuasselProtocol::receivePage(BufferId buffer, MsgId first, MsgId last)
+{
+    d.scrollback->link(buffer, first, last);
+}
+
+void QuasselProtocol::deliverMessage(const Message& message)
+{
+    // a message delivered in the background may be the first one of a
+    // channel whose join is still deferred
+    if (!d.deferredChannels.isEmpty() && message.bufferInfo().type() == BufferInfo::ChannelBuffer) {
+        const QString name = message.bufferInfo().bufferName();
+        IrcChannel* channel = d.network ? d.network->ircChannel(name) : 0;
+        if (channel && d.deferredChannels.contains(name))
+            announceChannel(channel);
+    }
+
+    QList<IrcMessage*> msgs = Quassel::convertMessage(message, connection());
+    foreach (IrcMessage* msg, msgs) {
+        msg->setProperty("msgId", message.msgId().toInt());
+        if (message.flags() & Message::Highlight)
+            msg->setProperty("highlight", true);
+        IrcProtocol::receiveMessage(msg);
     }
 }
 
+void QuasselProtocol::pauseReading(bool paused)
+{
+    // a queue that no longer fits its budget stops reading from the core
+    // until it has drained, heartbeats are answered late meanwhile
+    if (d.socket)
+        d.socket->setPaused(paused);
+}
+
+void QuasselProtocol::updateHighlights()
+{
+    QStringList patterns = d.highlights;
+    if (!connection()->nickName().isEmpty())
+        patterns.prepend(connection()->nickName());
+    d.highlightMatcher.setPatterns(patterns);
+}
+
 static QList<int> toIntList(const QVariantList& networkIds)
 {
     QList<int> lst;
@@ -269,7 +870,11 @@ void QuasselProtocol::clientDenied(const Protocol::ClientDenied& msg)
 
 void QuasselProtocol::clientRegistered(const Protocol::ClientRegistered& msg)
 {
+#ifdef HAVE_BACKLOG_FILTER
+    d.backlog->setFilterSupported(msg.featureList.contains("BacklogFilterType"));
+#else
     Q_UNUSED(msg);
+#endif
     setStatus(IrcConnection::Connecting);
     receiveInfo(Irc::RPL_MYINFO, "Welcome to Quassel");
 }
@@ -290,21 +895,32 @@ void QuasselProtocol::sessionState(const Protocol::SessionState& msg)
     receiveInfo(Irc::RPL_MYINFO, QString("Available networks: (%1)").arg(toString(nids)));
 
     NetworkId nid = findNetworkId(d.handler->networkId(), nids);
+    if (nid != d.snapshotId)
+        d.snapshot.clear();
     if (nid.isValid()) {
         RemotePeer* peer = d.handler->peer();
+        d.socket = qobject_cast<QuasselSocket*>(peer->socket());
+        pauseReading(d.queue->isCongested());
         peer->setParent(d.proxy);
         d.proxy->addPeer(peer);
-        d.network = new Network(nid, this);
+        d.latency->clear();
+        connect(peer, SIGNAL(lagUpdated(int)), d.latency, SLOT(addSample(int)));
+        updateSyncFilter();
         foreach (const QVariant& v, msg.bufferInfos) {
             BufferInfo buffer = v.value<BufferInfo>();
             if (buffer.networkId() == nid)
                 d.buffers.insert(buffer.bufferName(), buffer);
         }
-        connect(d.network, SIGNAL(initDone()), this, SLOT(initNetwork()));
-        d.network->setProxy(d.proxy);
-        d.proxy->synchronize(d.network);
+        // the last seen ids are synchronized before the network and the
+        // backlog, so that already seen backlog is not counted as unread
+        d.syncer = new BufferSyncer(d.proxy);
+        connect(d.syncer, SIGNAL(lastSeenMsgSet(BufferId,MsgId)), d.activity, SLOT(setLastSeenMsgId(BufferId,MsgId)));
+        d.proxy->synchronize(d.syncer);
+        synchronizeNetwork(nid);
         receiveInfo(Irc::RPL_MYINFO, QString("Connected to network %1").arg(nid.toInt()));
         receiveInfo(Irc::RPL_MYINFO, "Synchronizing...");
+        if (d.early)
+            initBuffers();
     } else {
         if (d.handler->networkId().isValid())
             receiveError(QString("Unknown network: %1").arg(d.handler->networkId().toInt()));
@@ -316,11 +932,76 @@ void QuasselProtocol::sessionState(const Protocol::SessionState& msg)
     d.handler = 0;
 }
 
+QuasselProtocol::ChannelState QuasselProtocol::channelState(IrcChannel* channel) const
+{
+    ChannelState state;
+    state.name = channel->name();
+    state.topic = channel->topic();
+    if (d.sync & SyncUsers) {
+        const bool modes = d.sync & SyncUserModes;
+        foreach (IrcUser* user, channel->ircUsers())
+            state.users.insert(user->nick(), modes ? channel->userModes(user->nick()) : QString());
+    }
+    return state;
+}
+
+void QuasselProtocol::saveChannels()
+{
+    // a network that did not finish synchronizing keeps the previous snapshot
+    if (d.network->isInitialized()) {
+        d.snapshot.clear();
+        d.snapshotId = d.network->networkId();
+        foreach (const QString& name, d.network->channels()) {
+            IrcChannel* channel = d.network->ircChannel(name);
+            if (channel && channel->isInitialized())
+                d.snapshot.insert(name.toLower(), channelState(channel));
+        }
+    }
+}
+
+void QuasselProtocol::synchronizeNetwork(NetworkId id)
+{
+    if (d.network) {
+        d.network->disconnect(this);
+        d.network->deleteLater();
+    }
+    d.network = new Network(id, this);
+    connect(d.network, SIGNAL(initDone()), this, SLOT(initNetwork()));
+    d.network->setProxy(d.proxy);
+    d.proxy->synchronize(d.network);
+}
+
+void QuasselProtocol::updateSyncFilter()
+{
+    // only the DataStream protocol is framed, see QuasselAuthHandler
+    if (d.socket && d.socket->isFramed())
+        d.socket->setSyncFilter(syncFilter(d.sync));
+}
+
 QString QuasselProtocol::prefix() const
 {
     return connection()->nickName() + "!" + connection()->userName() + "@quassel";
 }
 
+bool QuasselProtocol::isIgnored(const QString& sender) const
+{
+    if (!d.ignoredNicks.isEmpty() && d.ignoredNicks.contains(sender.section('!', 0, 0).toCaseFolded()))
+        return true;
+    if (!d.ignoreMatcher.isEmpty()) {
+        foreach (int index, d.ignoreMatcher.match(sender)) {
+            foreach (const QRegExp& mask, d.ignoredMasks.at(index)) {
+                if (mask.exactMatch(sender))
+                    return true;
+            }
+        }
+    }
+    foreach (const QRegExp& mask, d.ignoredWildcards) {
+        if (mask.exactMatch(sender))
+            return true;
+    }
+    return false;
+}
+
 BufferInfo QuasselProtocol::findBuffer(const QString& name) const
 {
     foreach (const BufferInfo& buffer, d.buffers) {
@@ -336,6 +1017,13 @@ void QuasselProtocol::receiveInfo(int code, const QString &info)
     IrcProtocol::receiveMessage(msg);
 }
 
+void QuasselProtocol::requestBacklog()
+{
+    d.proxy->synchronize(d.backlog);
+    foreach (const BufferInfo& buffer, d.buffers)
+        d.backlog->fetchBacklog(buffer.bufferId(), -1, -1, 100); // TODO: limit (100)
+}
+
 void QuasselProtocol::receiveError(const QString& error)
 {
     receiveInfo(Irc::ERR_UNKNOWNERROR, error);
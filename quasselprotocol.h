@@ -30,6 +30,10 @@
 #define QUASSELPROTOCOL_H
 
 #include <ircprotocol.h>
+#include <QRegExp>
+#include <QSet>
+#include <QStringList>
+#include "quasselmatcher.h"
 #include "protocol.h"
 #include "types.h"
 
@@ -38,7 +42,16 @@ class Network;
 class IrcChannel;
 class BufferInfo;
 class SignalProxy;
+class QuasselQueue;
+class QuasselScrollback;
+class QuasselActivity;
+class QuasselSocket;
+class QuasselCapture;
+class QuasselIndex;
+class QuasselLatency;
+class QuasselSession;
 class QuasselBacklog;
+class BufferSyncer;
 class QuasselAuthHandler;
 
 class QuasselProtocol : public IRC_PREPEND_NAMESPACE(IrcProtocol)
@@ -46,9 +59,62 @@ class QuasselProtocol : public IRC_PREPEND_NAMESPACE(IrcProtocol)
     Q_OBJECT
 
 public:
+    enum SyncFlag {
+        SyncTopics = 0x1,
+        SyncUsers = 0x2,
+        SyncUserModes = 0x4,
+        SyncDetails = 0x8, // away, real name, server, user and channel modes
+        SyncAll = SyncTopics | SyncUsers | SyncUserModes | SyncDetails
+    };
+    Q_DECLARE_FLAGS(SyncFlags, SyncFlag)
+
     explicit QuasselProtocol(IRC_PREPEND_NAMESPACE(IrcConnection*) connection);
     virtual ~QuasselProtocol();
 
+    bool earlyAvailability() const;
+    void setEarlyAvailability(bool enabled);
+
+    bool isThreaded() const;
+    void setThreaded(bool threaded);
+
+    bool isBackground() const;
+    void setBackground(bool background);
+
+    SyncFlags syncFlags() const;
+    void setSyncFlags(SyncFlags flags);
+
+    bool warmReconnect() const;
+    void setWarmReconnect(bool enabled);
+
+    QString captureFile() const;
+    void setCaptureFile(const QString& fileName);
+
+    QStringList highlights() const;
+    void setHighlights(const QStringList& highlights);
+
+    QStringList ignores() const;
+    void setIgnores(const QStringList& ignores);
+
+    bool isIndexEnabled() const;
+    void setIndexEnabled(bool enabled);
+    QuasselIndex* index() const;
+
+    int heartBeatInterval() const;
+    void setHeartBeatInterval(int secs);
+
+    QuasselScrollback* scrollback() const;
+    void fetchOlder(BufferId buffer, MsgId before, int count);
+    void fetchOlder(const QString& buffer, MsgId before, int count);
+
+    Network* network() const;
+    QuasselQueue* queue() const;
+    QuasselActivity* activity() const;
+    void markAsRead(const QString& buffer);
+    QuasselLatency* latency() const;
+    QuasselSession* session() const;
+    QuasselBacklog* backlog() const;
+    QuasselSocket* compressedSocket() const;
+
     virtual void open();
     virtual void close();
     virtual void read();
@@ -58,12 +124,17 @@ signals:
     void sendInput(const BufferInfo& buffer, const QString& message);
 
 protected slots:
+    void initBuffers();
     void initNetwork();
     void addChannel(IrcChannel* channel);
     void initChannel(IrcChannel* channel = 0);
     void updateTopic(IrcChannel* channel = 0);
     void updateUsers(IrcChannel* channel);
     void receiveMessage(const Message& message);
+    void receivePage(BufferId buffer, MsgId first, MsgId last);
+    void deliverMessage(const Message& message);
+    void pauseReading(bool paused);
+    void updateHighlights();
 
     void protocolUnsupported();
     void clientDenied(const Protocol::ClientDenied& msg);
@@ -73,19 +144,67 @@ protected slots:
     void sessionState(const Protocol::SessionState& msg);
 
 private:
+    struct ChannelState {
+        QString name;
+        QString topic;
+        QHash<QString, QString> users; // nick -> modes
+    };
+
+    ChannelState channelState(IrcChannel* channel) const;
+    void saveChannels();
+    void announceChannel(IrcChannel* channel);
+    void synchronizeNetwork(NetworkId id);
+    void updateSyncFilter();
+    void updateMembers(IrcChannel* channel, const ChannelState& previous);
+
     QString prefix() const;
+    bool isIgnored(const QString& sender) const;
     BufferInfo findBuffer(const QString& name) const;
     void receiveInfo(int code, const QString& info);
     void receiveError(const QString& info);
+    void requestBacklog();
 
     struct Private {
+        bool early;
+        bool threaded;
+        bool warm;
+        bool background;
+        int heartBeat;
+        int activityInterval;
+        SyncFlags sync;
+        SyncFlags refresh; // re-enabled while synchronizing the network again
         MsgId lastMsg;
         Network* network;
         SignalProxy* proxy;
+        BufferSyncer* syncer;
+        QuasselQueue* queue;
+        QuasselActivity* activity;
+        QuasselLatency* latency;
+        QuasselSession* session;
+        QuasselSocket* socket;
+        QuasselCapture* capture;
+        QuasselIndex* index;
+        QuasselScrollback* scrollback;
+        QString captureFile;
+        int captures; // connections captured to captureFile so far
         QuasselBacklog* backlog;
         QuasselAuthHandler* handler;
         QHash<QString, BufferInfo> buffers;
+        QSet<QString> announced;
+        QSet<QString> deferred; // topics
+        QSet<QString> deferredChannels;
+        QStringList highlights;
+        QuasselMatcher highlightMatcher;
+        QStringList ignores;
+        QSet<QString> ignoredNicks;
+        QuasselMatcher ignoreMatcher; // longest literal part of the masks
+        QList<QList<QRegExp> > ignoredMasks; // per matcher pattern
+        QList<QRegExp> ignoredWildcards; // masks without a literal part
+        NetworkId snapshotId;
+        QHash<QString, ChannelState> snapshot;
     } d;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(QuasselProtocol::SyncFlags)
+
 #endif // QUASSELPROTOCOL_H
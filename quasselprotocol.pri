@@ -9,20 +9,45 @@ PROTODIR = $$QUASSELDIR/protocols
 INCLUDEPATH += $$PWD $$QUASSELDIR $$PROTODIR/datastream $$PROTODIR/legacy
 DEPENDPATH += $$PWD $$QUASSELDIR $$PROTODIR/datastream $$PROTODIR/legacy
 
+HEADERS += $$PWD/quasselactivity.h
 HEADERS += $$PWD/quasselauthhandler.h
 HEADERS += $$PWD/quasselbacklog.h
+HEADERS += $$PWD/quasselcapture.h
+HEADERS += $$PWD/quasseldebug.h
+HEADERS += $$PWD/quasselfanout.h
+HEADERS += $$PWD/quasselindex.h
+HEADERS += $$PWD/quassellatency.h
+HEADERS += $$PWD/quasselmatcher.h
 HEADERS += $$PWD/quasselmessage.h
 HEADERS += $$PWD/quasselprotocol.h
+HEADERS += $$PWD/quasselqueue.h
+HEADERS += $$PWD/quasselreplay.h
+HEADERS += $$PWD/quasselscrollback.h
+HEADERS += $$PWD/quasselsession.h
+HEADERS += $$PWD/quasselsocket.h
 HEADERS += $$PWD/quasseltypes.h
 
+SOURCES += $$PWD/quasselactivity.cpp
 SOURCES += $$PWD/quasselauthhandler.cpp
 SOURCES += $$PWD/quasselbacklog.cpp
+SOURCES += $$PWD/quasselcapture.cpp
+SOURCES += $$PWD/quasseldebug.cpp
+SOURCES += $$PWD/quasselfanout.cpp
+SOURCES += $$PWD/quasselindex.cpp
+SOURCES += $$PWD/quassellatency.cpp
+SOURCES += $$PWD/quasselmatcher.cpp
 SOURCES += $$PWD/quasselmessage.cpp
 SOURCES += $$PWD/quasselprotocol.cpp
+SOURCES += $$PWD/quasselqueue.cpp
+SOURCES += $$PWD/quasselreplay.cpp
+SOURCES += $$PWD/quasselscrollback.cpp
+SOURCES += $$PWD/quasselsession.cpp
+SOURCES += $$PWD/quasselsocket.cpp
 
 HEADERS += $$QUASSELDIR/authhandler.h
 HEADERS += $$QUASSELDIR/backlogmanager.h
 HEADERS += $$QUASSELDIR/bufferinfo.h
+HEADERS += $$QUASSELDIR/buffersyncer.h
 HEADERS += $$QUASSELDIR/compressor.h
 HEADERS += $$QUASSELDIR/identity.h
 HEADERS += $$QUASSELDIR/ircchannel.h
@@ -40,6 +65,7 @@ HEADERS += $$QUASSELDIR/util.h
 SOURCES += $$QUASSELDIR/authhandler.cpp
 SOURCES += $$QUASSELDIR/backlogmanager.cpp
 SOURCES += $$QUASSELDIR/bufferinfo.cpp
+SOURCES += $$QUASSELDIR/buffersyncer.cpp
 SOURCES += $$QUASSELDIR/compressor.cpp
 SOURCES += $$QUASSELDIR/identity.cpp
 SOURCES += $$QUASSELDIR/ircchannel.cpp
@@ -70,4 +96,12 @@ mac {
 LIBS += -lz
 DEFINES += HAVE_ZLIB
 
+# Quassel >= 0.13 can request backlog filtered by message type
+BACKLOGMANAGER = $$cat($$QUASSELDIR/backlogmanager.h)
+contains(BACKLOGMANAGER, .*requestBacklogFiltered.*):DEFINES += HAVE_BACKLOG_FILTER
+
+# Quassel >= 0.13 messages carry sender prefixes, real name and avatar
+MESSAGE = $$cat($$QUASSELDIR/message.h)
+contains(MESSAGE, .*senderPrefixes.*):DEFINES += HAVE_SENDER_PREFIXES
+
 #SOURCES += $$PWD/3rdparty/3rdparty/miniz/miniz.c
@@ -0,0 +1,370 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselqueue.h"
+#include "bufferinfo.h"
+#include <QElapsedTimer>
+#include <QTimer>
+
+static const int SliceMsecs = 10; // max time spent delivering per event loop pass
+static const int CoalesceScan = 256; // max number of queued messages to coalesce with
+
+static qint64 messageSize(const Message& message)
+{
+    return sizeof(Message) + (message.contents().size() + message.sender().size()) * sizeof(QChar);
+}
+
+static QString senderNick(const Message& message)
+{
+    return message.sender().section('!', 0, 0);
+}
+
+QuasselQueue::QuasselQueue(QObject* parent) : QObject(parent)
+{
+    d.count = 0;
+    d.size = 0;
+    d.backlogSize = 0;
+    d.dropCount = 0;
+    d.congested = false;
+    d.ticket = 0;
+    d.maxCount = 10000;
+    d.maxSize = 16 * 1024 * 1024;
+    d.policy = CoalescePolicy;
+    d.delivery = LowPriority;
+
+    d.timer = new QTimer(this);
+    d.timer->setInterval(0);
+    connect(d.timer, SIGNAL(timeout()), this, SLOT(dequeue()));
+}
+
+int QuasselQueue::count() const
+{
+    return d.count;
+}
+
+qint64 QuasselQueue::size() const
+{
+    return d.size;
+}
+
+qint64 QuasselQueue::backlogSize() const
+{
+    return d.backlogSize;
+}
+
+int QuasselQueue::dropCount() const
+{
+    return d.dropCount;
+}
+
+bool QuasselQueue::isCongested() const
+{
+    return d.congested;
+}
+
+int QuasselQueue::maximumCount() const
+{
+    return d.maxCount;
+}
+
+void QuasselQueue::setMaximumCount(int count)
+{
+    d.maxCount = count;
+    reduce();
+    updateCongestion();
+}
+
+qint64 QuasselQueue::maximumSize() const
+{
+    return d.maxSize;
+}
+
+void QuasselQueue::setMaximumSize(qint64 size)
+{
+    d.maxSize = size;
+    reduce();
+    updateCongestion();
+}
+
+QuasselQueue::Policy QuasselQueue::policy() const
+{
+    return d.policy;
+}
+
+void QuasselQueue::setPolicy(Policy policy)
+{
+    d.policy = policy;
+}
+
+QuasselQueue::Priority QuasselQueue::deliveryPriority() const
+{
+    return d.delivery;
+}
+
+void QuasselQueue::setDeliveryPriority(Priority priority)
+{
+    // lower priorities are held, without waking up for them, until delivered again
+    d.delivery = priority;
+    if (isDeliverable()) {
+        if (!d.timer->isActive())
+            d.timer->start();
+    } else {
+        d.timer->stop();
+    }
+}
+
+int QuasselQueue::interval() const
+{
+    return d.timer->interval();
+}
+
+void QuasselQueue::setInterval(int msecs)
+{
+    d.timer->setInterval(msecs);
+}
+
+QList<MsgId> QuasselQueue::msgIds(BufferId buffer) const
+{
+    QList<MsgId> ids;
+    QHash<BufferId, Buffer>::const_iterator it = d.buffers.find(buffer);
+    if (it != d.buffers.constEnd()) {
+        foreach (const Entry& entry, it->entries)
+            ids += entry.message.msgId();
+    }
+    return ids;
+}
+
+void QuasselQueue::enqueue(const Message& message, Priority priority)
+{
+    // low priority messages are dropped or coalesced even while held, they
+    // are already accounted for in the scrollback and activity counters
+    const BufferId id = message.bufferInfo().bufferId();
+    Buffer& buffer = d.buffers[id];
+    if (priority != LowPriority || d.policy != CoalescePolicy || !isFull() || !coalesce(buffer, message)) {
+        Entry entry;
+        entry.message = message;
+        entry.priority = priority;
+        buffer.entries.enqueue(entry);
+        ++buffer.counts[priority];
+        if (priority == LowPriority)
+            d.dropOrder.enqueue(id);
+        d.size += messageSize(message);
+        if (message.flags() & Message::Backlog)
+            d.backlogSize += messageSize(message);
+        ++d.count;
+        schedule(id, buffer);
+        reduce();
+        updateCongestion();
+    }
+
+    if (isDeliverable() && !d.timer->isActive())
+        d.timer->start();
+}
+
+void QuasselQueue::clear()
+{
+    d.buffers.clear();
+    for (int i = HighPriority; i <= LowPriority; ++i)
+        d.ready[i].clear();
+    d.dropOrder.clear();
+    d.count = 0;
+    d.size = 0;
+    d.backlogSize = 0;
+    d.timer->stop();
+    updateCongestion();
+}
+
+void QuasselQueue::dequeue()
+{
+    // messages of a buffer are delivered in order, priorities only decide
+    // which buffer takes the next turn
+    QElapsedTimer timer;
+    timer.start();
+    int i = HighPriority;
+    while (i <= d.delivery) {
+        if (d.ready[i].isEmpty()) {
+            ++i;
+            continue;
+        }
+
+        const QPair<BufferId, int> turn = d.ready[i].dequeue();
+        QHash<BufferId, Buffer>::iterator it = d.buffers.find(turn.first);
+        if (it == d.buffers.end() || it->ticket != turn.second)
+            continue;
+
+        const Entry entry = it->entries.dequeue();
+        --it->counts[entry.priority];
+        it->scheduled = -1;
+        if (it->entries.isEmpty())
+            d.buffers.erase(it);
+        else
+            schedule(turn.first, *it);
+        release(entry.message);
+        --d.count;
+
+        emit messageDequeued(entry.message);
+        if (timer.elapsed() >= SliceMsecs)
+            break;
+        i = HighPriority;
+    }
+    if (!isDeliverable())
+        d.timer->stop();
+    updateCongestion();
+}
+
+QuasselQueue::Priority QuasselQueue::Buffer::priority() const
+{
+    if (counts[HighPriority])
+        return HighPriority;
+    if (counts[NormalPriority])
+        return NormalPriority;
+    return LowPriority;
+}
+
+void QuasselQueue::schedule(BufferId id, Buffer& buffer)
+{
+    // a buffer keeps its place in line unless its priority went up, in
+    // which case the new turn replaces the previous one
+    const Priority priority = buffer.priority();
+    if (buffer.scheduled == priority)
+        return;
+    buffer.ticket = ++d.ticket;
+    buffer.scheduled = priority;
+    d.ready[priority].enqueue(qMakePair(id, buffer.ticket));
+}
+
+bool QuasselQueue::isDeliverable() const
+{
+    for (int i = HighPriority; i <= d.delivery; ++i) {
+        if (!d.ready[i].isEmpty())
+            return true;
+    }
+    return false;
+}
+
+bool QuasselQueue::isFull() const
+{
+    return d.count >= d.maxCount || d.size >= d.maxSize;
+}
+
+bool QuasselQueue::coalesce(Buffer& buffer, const Message& message)
+{
+    // replace a message of the same sender in the trailing run of low
+    // priority messages, so that eg. a join followed by a part only
+    // delivers the part. nick changes are never merged, as later
+    // messages refer to the new nick
+    if (message.type() == Message::Nick)
+        return false;
+
+    QQueue<Entry>& entries = buffer.entries;
+    const QString nick = senderNick(message);
+    for (int i = entries.count() - 1; i >= 0 && i >= entries.count() - CoalesceScan; --i) {
+        const Entry& queued = entries.at(i);
+        if (queued.priority != LowPriority)
+            break;
+        if (queued.message.type() != Message::Nick && senderNick(queued.message) == nick) {
+            const Message dropped = queued.message;
+            release(dropped);
+            d.size += messageSize(message);
+            if (message.flags() & Message::Backlog)
+                d.backlogSize += messageSize(message);
+            ++d.dropCount;
+            entries.removeAt(i);
+            Entry entry;
+            entry.message = message;
+            entry.priority = LowPriority;
+            entries.enqueue(entry);
+            emit messageDropped(dropped);
+            return true;
+        }
+    }
+    return false;
+}
+
+void QuasselQueue::reduce()
+{
+    // only low priority messages are dropped, oldest first as far as the
+    // drop order tells. channel chat and highlights are never dropped, if
+    // they alone exceed the budget the queue reports congestion instead
+    while ((d.count > d.maxCount || d.size > d.maxSize) && !d.dropOrder.isEmpty()) {
+        const BufferId id = d.dropOrder.dequeue();
+        QHash<BufferId, Buffer>::iterator it = d.buffers.find(id);
+        if (it == d.buffers.end() || !it->counts[LowPriority])
+            continue;
+
+        int index = 0;
+        QQueue<Entry>& entries = it->entries;
+        while (index < entries.count() && entries.at(index).priority != LowPriority)
+            ++index;
+        if (index == entries.count())
+            continue;
+
+        const Message dropped = entries.takeAt(index).message;
+        release(dropped);
+        --it->counts[LowPriority];
+        --d.count;
+        ++d.dropCount;
+        if (entries.isEmpty())
+            d.buffers.erase(it);
+        emit messageDropped(dropped);
+    }
+
+    // delivered messages leave stale entries behind
+    if (d.dropOrder.count() > 2 * d.count + 64) {
+        d.dropOrder.clear();
+        QHash<BufferId, Buffer>::const_iterator it;
+        for (it = d.buffers.constBegin(); it != d.buffers.constEnd(); ++it) {
+            for (int i = 0; i < it->counts[LowPriority]; ++i)
+                d.dropOrder.enqueue(it.key());
+        }
+    }
+}
+
+void QuasselQueue::updateCongestion()
+{
+    // the budget is enforced by the reader: once dropping low priority
+    // messages no longer keeps the queue within its limits, the queue is
+    // congested until it has drained to three quarters of them
+    bool congested = d.congested;
+    if (!congested)
+        congested = d.count > d.maxCount || d.size > d.maxSize;
+    else
+        congested = 4 * d.count > 3 * qint64(d.maxCount) || 4 * d.size > 3 * d.maxSize;
+    if (d.congested != congested) {
+        d.congested = congested;
+        emit congestedChanged(congested);
+    }
+}
+
+void QuasselQueue::release(const Message& message)
+{
+    const qint64 size = messageSize(message);
+    d.size -= size;
+    if (message.flags() & Message::Backlog)
+        d.backlogSize -= size;
+}
@@ -0,0 +1,125 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUASSELQUEUE_H
+#define QUASSELQUEUE_H
+
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QQueue>
+#include "message.h"
+
+class QTimer;
+
+class QuasselQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority { HighPriority, NormalPriority, LowPriority };
+    enum Policy { DropPolicy, CoalescePolicy };
+
+    explicit QuasselQueue(QObject* parent = 0);
+
+    int count() const;
+    qint64 size() const;
+    qint64 backlogSize() const;
+    int dropCount() const;
+    bool isCongested() const;
+
+    int maximumCount() const;
+    void setMaximumCount(int count);
+
+    qint64 maximumSize() const;
+    void setMaximumSize(qint64 size);
+
+    Policy policy() const;
+    void setPolicy(Policy policy);
+
+    Priority deliveryPriority() const;
+    void setDeliveryPriority(Priority priority);
+
+    int interval() const;
+    void setInterval(int msecs);
+
+    QList<MsgId> msgIds(BufferId buffer) const;
+
+    void enqueue(const Message& message, Priority priority);
+    void clear();
+
+signals:
+    void messageDequeued(const Message& message);
+    void messageDropped(const Message& message);
+    void congestedChanged(bool congested);
+
+private slots:
+    void dequeue();
+
+private:
+    struct Entry {
+        Message message;
+        Priority priority;
+    };
+
+    struct Buffer {
+        Buffer() : ticket(0), scheduled(-1) { counts[HighPriority] = counts[NormalPriority] = counts[LowPriority] = 0; }
+        Priority priority() const;
+        int ticket; // the buffer's current turn, older turns in the ready lists are stale
+        int scheduled; // the priority of the current turn
+        int counts[LowPriority + 1];
+        QQueue<Entry> entries;
+    };
+
+    void schedule(BufferId id, Buffer& buffer);
+    bool isDeliverable() const;
+    bool isFull() const;
+    bool coalesce(Buffer& buffer, const Message& message);
+    void reduce();
+    void updateCongestion();
+    void release(const Message& message);
+
+    struct Private {
+        int count;
+        qint64 size;
+        qint64 backlogSize;
+        int dropCount;
+        bool congested;
+        int ticket;
+        int maxCount;
+        qint64 maxSize;
+        Policy policy;
+        Priority delivery;
+        QTimer* timer;
+        QHash<BufferId, Buffer> buffers;
+        QQueue<QPair<BufferId, int> > ready[LowPriority + 1]; // turns per buffer priority
+        QQueue<BufferId> dropOrder; // buffers in order of their low priority messages
+    } d;
+};
+
+#endif // QUASSELQUEUE_H
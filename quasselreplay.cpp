@@ -0,0 +1,125 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselreplay.h"
+#include "quasselcapture.h"
+#include <QTcpSocket>
+#include <QTimer>
+
+QuasselReplay::QuasselReplay(QObject* parent) : QTcpServer(parent)
+{
+    d.paced = true;
+    d.index = 0;
+
+    d.timer = new QTimer(this);
+    d.timer->setSingleShot(true);
+    connect(d.timer, SIGNAL(timeout()), this, SLOT(sendFrames()));
+
+    connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+bool QuasselReplay::load(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (magic != QuasselCapture::Magic || version != QuasselCapture::Version)
+        return false;
+
+    d.frames.clear();
+    while (!stream.atEnd()) {
+        Frame frame;
+        stream >> frame.time >> frame.data;
+        if (stream.status() != QDataStream::Ok)
+            return false;
+        d.frames += frame;
+    }
+    return true;
+}
+
+int QuasselReplay::frameCount() const
+{
+    return d.frames.count();
+}
+
+bool QuasselReplay::isPaced() const
+{
+    return d.paced;
+}
+
+void QuasselReplay::setPaced(bool paced)
+{
+    d.paced = paced;
+}
+
+void QuasselReplay::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket* socket = nextPendingConnection();
+        if (d.socket) {
+            // one replay at a time
+            socket->close();
+            socket->deleteLater();
+            continue;
+        }
+
+        d.index = 0;
+        d.socket = socket;
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), d.timer, SLOT(stop()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        sendFrames();
+    }
+}
+
+void QuasselReplay::onReadyRead()
+{
+    // the replayed core does not care what the client says
+    if (d.socket)
+        d.socket->readAll();
+}
+
+void QuasselReplay::sendFrames()
+{
+    if (!d.socket)
+        return;
+
+    while (d.index < d.frames.count()) {
+        const Frame& frame = d.frames.at(d.index++);
+        d.socket->write(frame.data);
+        if (d.paced && d.index < d.frames.count()) {
+            d.timer->start(static_cast<int>(d.frames.at(d.index).time - frame.time));
+            return;
+        }
+    }
+    emit finished();
+}
@@ -0,0 +1,270 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselscrollback.h"
+#include <algorithm>
+
+// The most recent messages of each buffer, kept sorted by message id so
+// that live messages append and older backlog pages merge in. Pages and
+// live messages may leave gaps between each other, so every entry tells
+// whether it directly follows the previous one, and only a run without
+// gaps is served. Senders repeat a lot, so they are shared through a pool
+// instead of every entry holding its own copy of the same string. With
+// Quassel >= 0.13 the real names and avatars of the senders go there too.
+
+#ifdef HAVE_SENDER_PREFIXES
+static const int PooledStrings = 3; // pooled strings per entry
+#else
+static const int PooledStrings = 1;
+#endif
+
+QuasselScrollback::QuasselScrollback()
+{
+    d.count = 0;
+    d.maxCount = 20000;
+    d.maxBufferCount = 500;
+}
+
+int QuasselScrollback::count() const
+{
+    return d.count;
+}
+
+int QuasselScrollback::count(BufferId buffer) const
+{
+    QHash<BufferId, Ring>::const_iterator it = d.rings.find(buffer);
+    if (it != d.rings.constEnd())
+        return it->entries.count();
+    return 0;
+}
+
+QList<BufferId> QuasselScrollback::buffers() const
+{
+    return d.rings.keys();
+}
+
+int QuasselScrollback::maximumCount() const
+{
+    return d.maxCount;
+}
+
+void QuasselScrollback::setMaximumCount(int count)
+{
+    d.maxCount = count;
+    reduce();
+}
+
+int QuasselScrollback::maximumBufferCount() const
+{
+    return d.maxBufferCount;
+}
+
+void QuasselScrollback::setMaximumBufferCount(int count)
+{
+    d.maxBufferCount = count;
+    QHash<BufferId, Ring>::iterator it;
+    for (it = d.rings.begin(); it != d.rings.end(); ++it) {
+        const int excess = it->entries.count() - qMax(0, count);
+        if (excess > 0) {
+            it->entries.remove(0, excess);
+            d.count -= excess;
+        }
+    }
+    reduce();
+}
+
+MsgId QuasselScrollback::oldestMsgId(BufferId buffer) const
+{
+    QHash<BufferId, Ring>::const_iterator it = d.rings.find(buffer);
+    if (it != d.rings.constEnd() && !it->entries.isEmpty())
+        return it->entries.first().msgId;
+    return MsgId();
+}
+
+void QuasselScrollback::insert(const Message& message)
+{
+    if (!message.msgId().isValid() || d.maxBufferCount <= 0)
+        return;
+
+    Ring& ring = d.rings[message.bufferInfo().bufferId()];
+    QVector<Entry>& entries = ring.entries;
+
+    // live messages of a buffer arrive without gaps, backlog gets linked
+    // once its whole page has been received
+    const bool live = !(message.flags() & Message::Backlog);
+    int index = entries.count();
+    if (!entries.isEmpty() && message.msgId() <= entries.last().msgId) {
+        QVector<Entry>::iterator it = std::lower_bound(entries.begin(), entries.end(), message.msgId());
+        if (it != entries.end() && it->msgId == message.msgId())
+            return;
+        // older than everything kept in a full buffer
+        if (it == entries.begin() && entries.count() >= d.maxBufferCount)
+            return;
+        index = it - entries.begin();
+    }
+
+    Entry entry;
+    entry.msgId = message.msgId();
+    entry.timestamp = message.timestamp().toTime_t();
+    entry.type = message.type();
+    entry.flags = message.flags() & ~Message::Backlog;
+    entry.linked = live && ring.live && index == entries.count();
+    entry.sender = *d.senders.insert(message.sender());
+    entry.contents = message.contents();
+#ifdef HAVE_SENDER_PREFIXES
+    entry.senderPrefixes = message.senderPrefixes();
+    entry.realName = *d.senders.insert(message.realName());
+    entry.avatarUrl = *d.senders.insert(message.avatarUrl());
+#endif
+    if (index < entries.count())
+        entries[index].linked = false;
+    entries.insert(index, entry);
+    ring.info = message.bufferInfo();
+    if (live)
+        ring.live = true;
+    ++d.count;
+
+    if (entries.count() > d.maxBufferCount) {
+        entries.remove(0);
+        --d.count;
+    }
+    if (d.count > d.maxCount || d.senders.count() > qMax(PooledStrings * d.count, 1024))
+        reduce();
+}
+
+void QuasselScrollback::link(BufferId buffer, MsgId first, MsgId last)
+{
+    // the core had no other messages from first up to last, which is either
+    // the message the page was requested before or, for an invalid last,
+    // the newest message at the time
+    QHash<BufferId, Ring>::iterator it = d.rings.find(buffer);
+    if (it == d.rings.end() || !first.isValid())
+        return;
+
+    QVector<Entry>& entries = it->entries;
+    QVector<Entry>::iterator entry = std::upper_bound(entries.begin(), entries.end(), first, &QuasselScrollback::isBefore);
+    for (; entry != entries.end() && (!last.isValid() || entry->msgId <= last); ++entry)
+        entry->linked = true;
+    if (!last.isValid())
+        it->live = true;
+}
+
+void QuasselScrollback::interrupt()
+{
+    // messages may have been missed while not connected
+    QHash<BufferId, Ring>::iterator it;
+    for (it = d.rings.begin(); it != d.rings.end(); ++it)
+        it->live = false;
+}
+
+QList<Message> QuasselScrollback::messages(BufferId buffer, MsgId before, int count) const
+{
+    QList<Message> messages;
+    QHash<BufferId, Ring>::const_iterator it = d.rings.find(buffer);
+    if (it == d.rings.constEnd() || count <= 0)
+        return messages;
+
+    // only the run directly before the anchor, which is either a kept
+    // message or, for an invalid anchor, the newest live message
+    const QVector<Entry>& entries = it->entries;
+    QVector<Entry>::const_iterator end = entries.constEnd();
+    if (before.isValid()) {
+        end = std::lower_bound(entries.constBegin(), entries.constEnd(), before);
+        if (end == entries.constEnd() || end->msgId != before || !end->linked)
+            return messages;
+    } else if (!it->live) {
+        return messages;
+    }
+    QVector<Entry>::const_iterator begin = end;
+    while (begin != entries.constBegin() && count-- > 0) {
+        --begin;
+        if (!begin->linked)
+            break;
+    }
+
+    for (; begin != end; ++begin) {
+#ifdef HAVE_SENDER_PREFIXES
+        Message message(QDateTime::fromTime_t(begin->timestamp), it->info, Message::Type(begin->type),
+                        begin->contents, begin->sender, begin->senderPrefixes, begin->realName,
+                        begin->avatarUrl, Message::Flags(begin->flags) | Message::Backlog);
+#else
+        Message message(QDateTime::fromTime_t(begin->timestamp), it->info, Message::Type(begin->type),
+                        begin->contents, begin->sender, Message::Flags(begin->flags) | Message::Backlog);
+#endif
+        message.setMsgId(begin->msgId);
+        messages += message;
+    }
+    return messages;
+}
+
+void QuasselScrollback::clear()
+{
+    d.count = 0;
+    d.senders.clear();
+    d.rings.clear();
+}
+
+bool QuasselScrollback::isBefore(const MsgId& msgId, const Entry& entry)
+{
+    return msgId < entry.msgId;
+}
+
+void QuasselScrollback::reduce()
+{
+    // over the global limit, the largest buffers give up their oldest entries.
+    // an eighth at a time, so that a full scrollback does not rescan all
+    // buffers for every inserted message
+    QHash<BufferId, Ring>::iterator it;
+    while (d.count > d.maxCount) {
+        QHash<BufferId, Ring>::iterator largest = d.rings.end();
+        for (it = d.rings.begin(); it != d.rings.end(); ++it) {
+            if (largest == d.rings.end() || it->entries.count() > largest->entries.count())
+                largest = it;
+        }
+        if (largest == d.rings.end() || largest->entries.isEmpty())
+            break;
+        const int excess = qMin(largest->entries.count(), qMax(d.count - d.maxCount, largest->entries.count() / 8));
+        largest->entries.remove(0, excess);
+        d.count -= excess;
+    }
+
+    // drop senders no longer referenced once the pool outgrows the entries
+    if (d.senders.count() > qMax(PooledStrings * d.count, 1024)) {
+        QSet<QString> senders;
+        for (it = d.rings.begin(); it != d.rings.end(); ++it) {
+            foreach (const Entry& entry, it->entries) {
+                senders.insert(entry.sender);
+#ifdef HAVE_SENDER_PREFIXES
+                senders.insert(entry.realName);
+                senders.insert(entry.avatarUrl);
+#endif
+            }
+        }
+        d.senders = senders;
+    }
+}
@@ -0,0 +1,98 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUASSELSCROLLBACK_H
+#define QUASSELSCROLLBACK_H
+
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include "bufferinfo.h"
+#include "message.h"
+
+class QuasselScrollback
+{
+public:
+    QuasselScrollback();
+
+    int count() const;
+    int count(BufferId buffer) const;
+    QList<BufferId> buffers() const;
+
+    int maximumCount() const;
+    void setMaximumCount(int count);
+
+    int maximumBufferCount() const;
+    void setMaximumBufferCount(int count);
+
+    MsgId oldestMsgId(BufferId buffer) const;
+
+    void insert(const Message& message);
+    void link(BufferId buffer, MsgId first, MsgId last);
+    void interrupt();
+
+    QList<Message> messages(BufferId buffer, MsgId before, int count) const;
+    void clear();
+
+private:
+    struct Entry {
+        bool operator<(const MsgId& other) const { return msgId < other; }
+        MsgId msgId;
+        uint timestamp;
+        int type;
+        quint8 flags;
+        bool linked; // directly follows the previous entry, without a gap
+        QString sender; // shared via the sender pool
+        QString contents;
+#ifdef HAVE_SENDER_PREFIXES
+        QString senderPrefixes;
+        QString realName; // shared via the sender pool
+        QString avatarUrl; // shared via the sender pool
+#endif
+    };
+
+    struct Ring {
+        Ring() : live(false) { }
+        BufferInfo info;
+        bool live; // the next live message follows the newest entry
+        QVector<Entry> entries; // oldest first
+    };
+
+    static bool isBefore(const MsgId& msgId, const Entry& entry);
+    void reduce();
+
+    struct Private {
+        int count;
+        int maxCount;
+        int maxBufferCount;
+        QSet<QString> senders;
+        QHash<BufferId, Ring> rings;
+    } d;
+};
+
+#endif // QUASSELSCROLLBACK_H
@@ -0,0 +1,197 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselsession.h"
+#include <IrcConnection>
+#include <QHash>
+#ifndef QT_NO_SSL
+#include <QSslSocket>
+#include <QSslConfiguration>
+#endif
+
+IRC_USE_NAMESPACE
+
+// Caches TLS session tickets per core (host:port) for the whole process,
+// and offers the cached ticket whenever the connection socket starts
+// connecting again, including the legacy fallback reconnect. Requires
+// Qt >= 5.2, otherwise every handshake is a full one.
+//
+// Qt does not report whether a handshake resumed a session. Up to TLS 1.2,
+// a resumed session keeps the ticket that was offered, unless the core
+// chose to renew it, so comparing the two is a conservative heuristic.
+// TLS 1.3 tickets arrive after the handshake and are single use, so they
+// are cached as they arrive (Qt >= 5.15) and resumption is not reported.
+
+#if !defined(QT_NO_SSL) && QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
+#define QUASSEL_SESSION_TICKETS
+typedef QHash<QString, QByteArray> TicketCache;
+Q_GLOBAL_STATIC(TicketCache, ticketCache)
+#endif
+
+QuasselSession::QuasselSession(IrcConnection* connection, QObject* parent) : QObject(parent)
+{
+    d.enabled = true;
+    d.attempted = false;
+    d.resumed = false;
+    d.time = -1;
+    d.connection = connection;
+    connect(connection, SIGNAL(secureChanged(bool)), this, SLOT(attach()));
+    attach();
+}
+
+bool QuasselSession::isEnabled() const
+{
+    return d.enabled;
+}
+
+void QuasselSession::setEnabled(bool enabled)
+{
+    d.enabled = enabled;
+}
+
+bool QuasselSession::isResumeAttempted() const
+{
+    return d.attempted;
+}
+
+bool QuasselSession::isResumed() const
+{
+    return d.resumed;
+}
+
+qint64 QuasselSession::handshakeTime() const
+{
+    return d.time;
+}
+
+void QuasselSession::attach()
+{
+    // the connection replaces its socket when it becomes secure
+#ifdef QUASSEL_SESSION_TICKETS
+    QSslSocket* socket = qobject_cast<QSslSocket*>(d.connection->socket());
+    if (d.socket.data() == socket)
+        return;
+    if (d.socket)
+        d.socket->disconnect(this);
+    d.socket = socket;
+    if (socket) {
+        connect(socket, SIGNAL(stateChanged(QAbstractSocket::SocketState)), this, SLOT(onStateChanged(QAbstractSocket::SocketState)));
+        connect(socket, SIGNAL(connected()), this, SLOT(onConnected()));
+        connect(socket, SIGNAL(encrypted()), this, SLOT(onEncrypted()));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        connect(socket, SIGNAL(newSessionTicketReceived()), this, SLOT(onSessionTicket()));
+#endif
+        if (socket->state() == QAbstractSocket::ConnectedState && !socket->isEncrypted())
+            d.timer.start();
+    }
+#endif
+}
+
+void QuasselSession::clearCache()
+{
+#ifdef QUASSEL_SESSION_TICKETS
+    ticketCache()->clear();
+#endif
+}
+
+void QuasselSession::onStateChanged(QAbstractSocket::SocketState state)
+{
+#ifdef QUASSEL_SESSION_TICKETS
+    // the ticket must be in place before the handshake starts
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket || state != QAbstractSocket::HostLookupState || !d.connection->isSecure())
+        return;
+
+    d.attempted = false;
+    d.resumed = false;
+    d.time = -1;
+    d.ticket.clear();
+
+    QSslConfiguration config = socket->sslConfiguration();
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, !d.enabled);
+    if (d.enabled) {
+        d.ticket = ticketCache()->value(cacheKey());
+        d.attempted = !d.ticket.isEmpty();
+    }
+    config.setSessionTicket(d.ticket);
+    socket->setSslConfiguration(config);
+#else
+    Q_UNUSED(state);
+#endif
+}
+
+void QuasselSession::onConnected()
+{
+    d.timer.start();
+}
+
+void QuasselSession::onEncrypted()
+{
+#ifdef QUASSEL_SESSION_TICKETS
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket)
+        return;
+
+    d.time = d.timer.isValid() ? d.timer.elapsed() : -1;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    if (socket->sessionProtocol() == QSsl::TlsV1_3) {
+        d.resumed = false;
+        if (d.attempted)
+            ticketCache()->remove(cacheKey());
+        emit handshakeFinished(d.time, d.resumed);
+        return;
+    }
+#endif
+    const QByteArray ticket = socket->sslConfiguration().sessionTicket();
+    d.resumed = d.attempted && ticket == d.ticket;
+    if (d.enabled && !ticket.isEmpty())
+        ticketCache()->insert(cacheKey(), ticket);
+    else if (d.attempted)
+        ticketCache()->remove(cacheKey());
+
+    emit handshakeFinished(d.time, d.resumed);
+#endif
+}
+
+void QuasselSession::onSessionTicket()
+{
+#ifdef QUASSEL_SESSION_TICKETS
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket || !d.enabled)
+        return;
+
+    const QByteArray ticket = socket->sslConfiguration().sessionTicket();
+    if (!ticket.isEmpty())
+        ticketCache()->insert(cacheKey(), ticket);
+#endif
+}
+
+QString QuasselSession::cacheKey() const
+{
+    return QString("%1:%2").arg(d.connection->host()).arg(d.connection->port());
+}
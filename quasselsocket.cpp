@@ -0,0 +1,454 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselsocket.h"
+#include "quasselcapture.h"
+#include "datastreampeer.h"
+#include <QElapsedTimer>
+#include <QDataStream>
+#include <QtEndian>
+#include <QThread>
+#include <zlib.h>
+
+static const int ChunkSize = 64 * 1024;
+static const int BufferSize = 1024 * 1024;
+
+// appends to the output buffer, reusing its reserved capacity
+template <typename Process>
+static bool process(z_stream* stream, const char* data, int size, QByteArray* output, Process func)
+{
+    int used = output->size();
+    stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream->avail_in = size;
+    do {
+        output->resize(used + ChunkSize);
+        stream->next_out = reinterpret_cast<Bytef*>(output->data() + used);
+        stream->avail_out = ChunkSize;
+        int status = func(stream, Z_SYNC_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            output->resize(used);
+            return false;
+        }
+        used += ChunkSize - stream->avail_out;
+    } while (stream->avail_out == 0);
+    output->resize(used);
+    return true;
+}
+
+QuasselInflater::QuasselInflater(QObject* parent) : QObject(parent)
+{
+    d.stream = new z_stream;
+    d.stream->zalloc = Z_NULL;
+    d.stream->zfree = Z_NULL;
+    d.stream->opaque = Z_NULL;
+    d.stream->next_in = Z_NULL;
+    d.stream->avail_in = 0;
+    inflateInit(d.stream);
+}
+
+QuasselInflater::~QuasselInflater()
+{
+    inflateEnd(d.stream);
+    delete d.stream;
+}
+
+bool QuasselInflater::inflate(const char* data, int size, QByteArray* output)
+{
+    return process(d.stream, data, size, output, ::inflate);
+}
+
+void QuasselInflater::decompress(QuasselChunk* chunk)
+{
+    // the chunk belongs to this thread until it is handed back
+    QElapsedTimer timer;
+    timer.start();
+
+    chunk->output.resize(0);
+    chunk->failed = !inflate(chunk->input.constData(), chunk->input.size(), &chunk->output);
+    chunk->nsecs = timer.nsecsElapsed();
+    emit decompressed(chunk);
+}
+
+QuasselSocket::QuasselSocket(QTcpSocket* socket, bool compressed, bool threaded, QObject* parent) : QTcpSocket(parent)
+{
+    d.socket = socket;
+    d.thread = 0;
+    d.inflater = 0;
+    d.deflater = 0;
+    d.framed = false;
+    d.paused = false;
+    d.filtered = 0;
+    d.offset = 0;
+    d.scanned = 0;
+    d.compressed = 0;
+    d.decompressed = 0;
+    d.nsecs = 0;
+
+    // reserved capacity survives resize(0), so the buffers are allocated once
+    d.input.reserve(ChunkSize);
+    d.output.reserve(ChunkSize);
+    d.buffer.reserve(BufferSize);
+
+    if (compressed) {
+        d.inflater = new QuasselInflater;
+        d.deflater = new z_stream;
+        d.deflater->zalloc = Z_NULL;
+        d.deflater->zfree = Z_NULL;
+        d.deflater->opaque = Z_NULL;
+        deflateInit(d.deflater, Z_BEST_COMPRESSION);
+
+        if (threaded) {
+            qRegisterMetaType<QuasselChunk*>("QuasselChunk*");
+            d.thread = new QThread(this);
+            d.inflater->moveToThread(d.thread);
+            d.thread->start();
+        }
+
+        // queued when the inflater lives in the I/O thread
+        connect(d.inflater, SIGNAL(decompressed(QuasselChunk*)), this, SLOT(onDecompressed(QuasselChunk*)));
+    }
+
+    connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(socket, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
+    connect(socket, SIGNAL(stateChanged(QAbstractSocket::SocketState)), this, SLOT(onSocketStateChanged(QAbstractSocket::SocketState)));
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onSocketError(QAbstractSocket::SocketError)));
+
+    setPeerName(socket->peerName());
+    setPeerAddress(socket->peerAddress());
+    setPeerPort(socket->peerPort());
+    setLocalAddress(socket->localAddress());
+    setLocalPort(socket->localPort());
+    setSocketState(socket->state());
+    setOpenMode(QIODevice::ReadWrite | QIODevice::Unbuffered);
+
+    // data may have arrived already during the handshake
+    if (socket->bytesAvailable())
+        QMetaObject::invokeMethod(this, "onReadyRead", Qt::QueuedConnection);
+}
+
+QuasselSocket::~QuasselSocket()
+{
+    if (d.thread) {
+        d.thread->quit();
+        d.thread->wait();
+    }
+    delete d.inflater;
+    qDeleteAll(d.chunks);
+
+    if (d.deflater) {
+        deflateEnd(d.deflater);
+        delete d.deflater;
+    }
+}
+
+QTcpSocket* QuasselSocket::socket() const
+{
+    return d.socket;
+}
+
+bool QuasselSocket::isCompressed() const
+{
+    return d.inflater;
+}
+
+bool QuasselSocket::isThreaded() const
+{
+    return d.thread;
+}
+
+QuasselCapture* QuasselSocket::capture() const
+{
+    return d.capture;
+}
+
+void QuasselSocket::setCapture(QuasselCapture* capture)
+{
+    d.capture = capture;
+}
+
+qint64 QuasselSocket::compressedBytes() const
+{
+    return d.compressed;
+}
+
+qint64 QuasselSocket::decompressedBytes() const
+{
+    return d.decompressed;
+}
+
+qint64 QuasselSocket::decompressionTime() const
+{
+    return d.nsecs;
+}
+
+bool QuasselSocket::isFramed() const
+{
+    return d.framed;
+}
+
+void QuasselSocket::setFramed(bool framed)
+{
+    // only whole DataStream messages are exposed, so that the sync filter
+    // always starts on a message boundary. must be set before anything
+    // has been read
+    d.framed = framed;
+    filter();
+}
+
+QSet<QByteArray> QuasselSocket::syncFilter() const
+{
+    return d.filter;
+}
+
+void QuasselSocket::setSyncFilter(const QSet<QByteArray>& calls)
+{
+    // applies to the messages that have not been exposed yet
+    d.filter = calls;
+}
+
+int QuasselSocket::filteredCount() const
+{
+    return d.filtered;
+}
+
+bool QuasselSocket::isPaused() const
+{
+    return d.paused;
+}
+
+void QuasselSocket::setPaused(bool paused)
+{
+    // a bounded read buffer makes Qt stop reading once it fills up, so
+    // that the core is throttled by TCP flow control meanwhile
+    if (d.paused == paused)
+        return;
+    d.paused = paused;
+    d.socket->setReadBufferSize(paused ? ChunkSize : 0);
+    if (!paused && d.socket->bytesAvailable())
+        QMetaObject::invokeMethod(this, "onReadyRead", Qt::QueuedConnection);
+}
+
+qint64 QuasselSocket::bytesAvailable() const
+{
+    return d.scanned - d.offset;
+}
+
+void QuasselSocket::disconnectFromHost()
+{
+    d.socket->disconnectFromHost();
+}
+
+qint64 QuasselSocket::readData(char* data, qint64 maxSize)
+{
+    qint64 size = qMin(maxSize, bytesAvailable());
+    memcpy(data, d.buffer.constData() + d.offset, size);
+    d.offset += size;
+    if (d.offset == d.buffer.size()) {
+        d.buffer.resize(0);
+        d.offset = 0;
+        d.scanned = 0;
+    }
+    return size;
+}
+
+qint64 QuasselSocket::writeData(const char* data, qint64 size)
+{
+    if (!d.deflater)
+        return d.socket->write(data, size);
+
+    d.output.resize(0);
+    if (!process(d.deflater, data, size, &d.output, ::deflate))
+        return -1;
+    if (d.socket->write(d.output) != d.output.size())
+        return -1;
+    return size;
+}
+
+void QuasselSocket::onReadyRead()
+{
+    if (d.paused)
+        return;
+
+    qint64 available = d.socket->bytesAvailable();
+    if (available <= 0)
+        return;
+
+    d.compressed += available;
+
+    if (d.thread) {
+        QuasselChunk* chunk = 0;
+        if (!d.spare.isEmpty()) {
+            chunk = d.spare.takeLast();
+        } else {
+            chunk = new QuasselChunk;
+            chunk->input.reserve(ChunkSize);
+            chunk->output.reserve(4 * ChunkSize);
+            d.chunks += chunk;
+        }
+        chunk->input.resize(static_cast<int>(available));
+        chunk->input.resize(static_cast<int>(d.socket->read(chunk->input.data(), available)));
+        if (d.capture)
+            d.capture->write(chunk->input);
+        QMetaObject::invokeMethod(d.inflater, "decompress", Qt::QueuedConnection, Q_ARG(QuasselChunk*, chunk));
+        return;
+    }
+
+    // read and inflate in one batch, straight into the read buffer
+    d.input.resize(static_cast<int>(available));
+    available = d.socket->read(d.input.data(), available);
+    if (d.capture)
+        d.capture->write(d.input);
+
+    if (!d.inflater) {
+        compact();
+        d.buffer.append(d.input);
+        d.decompressed += available;
+        d.input.resize(0);
+        filter();
+        if (bytesAvailable())
+            emit readyRead();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    compact();
+    int size = d.buffer.size();
+    if (!d.inflater->inflate(d.input.constData(), available, &d.buffer)) {
+        onDecompressionError();
+        return;
+    }
+    d.nsecs += timer.nsecsElapsed();
+    d.decompressed += d.buffer.size() - size;
+    d.input.resize(0);
+
+    const qint64 scanned = d.scanned;
+    filter();
+    if (d.scanned > scanned)
+        emit readyRead();
+}
+
+void QuasselSocket::onDecompressed(QuasselChunk* chunk)
+{
+    d.spare += chunk;
+    if (chunk->failed) {
+        onDecompressionError();
+        return;
+    }
+
+    d.nsecs += chunk->nsecs;
+    d.decompressed += chunk->output.size();
+
+    compact();
+    d.buffer.append(chunk->output);
+    chunk->input.resize(0);
+    chunk->output.resize(0);
+    filter();
+    if (bytesAvailable())
+        emit readyRead();
+}
+
+void QuasselSocket::onDecompressionError()
+{
+    setErrorString(tr("Decompression failed"));
+    d.socket->abort();
+}
+
+void QuasselSocket::onSocketStateChanged(QAbstractSocket::SocketState state)
+{
+    setSocketState(state);
+    emit stateChanged(state);
+}
+
+void QuasselSocket::onSocketError(QAbstractSocket::SocketError socketError)
+{
+    setSocketError(socketError);
+    setErrorString(d.socket->errorString());
+    emit error(socketError);
+}
+
+void QuasselSocket::compact()
+{
+    // drop consumed data once it makes up half of the buffer
+    if (d.offset > 0 && d.offset >= d.buffer.size() / 2) {
+        d.buffer.remove(0, d.offset);
+        d.scanned -= d.offset;
+        d.offset = 0;
+    }
+}
+
+void QuasselSocket::filter()
+{
+    if (!d.framed) {
+        d.scanned = d.buffer.size();
+        return;
+    }
+
+    // expose complete messages only and drop filtered ones before the peer
+    // gets to decode and dispatch them, moving the rest down in one pass
+    char* data = d.buffer.data();
+    int read = d.scanned;
+    int write = d.scanned;
+    while (d.buffer.size() - read >= 4) {
+        const quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data + read));
+        if (size > quint32(d.buffer.size() - read - 4))
+            break;
+        if (d.filter.isEmpty() || !isFiltered(data + read + 4, size)) {
+            if (write != read)
+                memmove(data + write, data + read, 4 + size);
+            write += 4 + size;
+        } else {
+            ++d.filtered;
+        }
+        read += 4 + size;
+    }
+    if (write != read) {
+        memmove(data + write, data + read, d.buffer.size() - read);
+        d.buffer.resize(d.buffer.size() - (read - write));
+    }
+    d.scanned = write;
+}
+
+bool QuasselSocket::isFiltered(const char* data, int size) const
+{
+    // a sync call is a list of the request type, class, object and slot
+    // names followed by the arguments, only the names are decoded here
+    QDataStream stream(QByteArray::fromRawData(data, size));
+    stream.setVersion(QDataStream::Qt_4_2);
+    quint32 count = 0;
+    stream >> count;
+    if (count < 4)
+        return false;
+
+    QVariant type, className, objectName, slotName;
+    stream >> type;
+    if (stream.status() != QDataStream::Ok || type.toInt() != DataStreamPeer::Sync)
+        return false;
+    stream >> className >> objectName >> slotName;
+    return stream.status() == QDataStream::Ok && d.filter.contains(className.toByteArray() + "::" + slotName.toByteArray());
+}
@@ -0,0 +1,144 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUASSELSOCKET_H
+#define QUASSELSOCKET_H
+
+#include <QTcpSocket>
+#include <QPointer>
+#include <QSet>
+
+class QThread;
+class QuasselCapture;
+struct z_stream_s;
+
+// a unit of work handed to the inflater thread and back, with buffers
+// that are reused for the lifetime of the socket
+struct QuasselChunk
+{
+    QByteArray input;
+    QByteArray output;
+    qint64 nsecs;
+    bool failed;
+};
+Q_DECLARE_METATYPE(QuasselChunk*)
+
+class QuasselInflater : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QuasselInflater(QObject* parent = 0);
+    ~QuasselInflater();
+
+    bool inflate(const char* data, int size, QByteArray* output);
+
+public slots:
+    void decompress(QuasselChunk* chunk);
+
+signals:
+    void decompressed(QuasselChunk* chunk);
+
+private:
+    struct Private {
+        z_stream_s* stream;
+    } d;
+};
+
+class QuasselSocket : public QTcpSocket
+{
+    Q_OBJECT
+
+public:
+    QuasselSocket(QTcpSocket* socket, bool compressed, bool threaded, QObject* parent = 0);
+    ~QuasselSocket();
+
+    QTcpSocket* socket() const;
+    bool isCompressed() const;
+    bool isThreaded() const;
+
+    QuasselCapture* capture() const;
+    void setCapture(QuasselCapture* capture);
+
+    qint64 compressedBytes() const;
+    qint64 decompressedBytes() const;
+    qint64 decompressionTime() const;
+
+    bool isFramed() const;
+    void setFramed(bool framed);
+
+    QSet<QByteArray> syncFilter() const;
+    void setSyncFilter(const QSet<QByteArray>& calls);
+    int filteredCount() const;
+
+    bool isPaused() const;
+    void setPaused(bool paused);
+
+    qint64 bytesAvailable() const;
+    void disconnectFromHost();
+
+protected:
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char* data, qint64 size);
+
+private slots:
+    void onReadyRead();
+    void onDecompressed(QuasselChunk* chunk);
+    void onDecompressionError();
+    void onSocketStateChanged(QAbstractSocket::SocketState state);
+    void onSocketError(QAbstractSocket::SocketError socketError);
+
+private:
+    void compact();
+    void filter();
+    bool isFiltered(const char* data, int size) const;
+
+    struct Private {
+        QTcpSocket* socket;
+        QThread* thread;
+        QuasselInflater* inflater;
+        z_stream_s* deflater;
+        QPointer<QuasselCapture> capture;
+        QByteArray input;
+        QByteArray output;
+        QByteArray buffer;
+        QList<QuasselChunk*> chunks;
+        QList<QuasselChunk*> spare;
+        QSet<QByteArray> filter; // "Class::slot" sync calls to drop
+        bool framed;
+        bool paused;
+        int filtered;
+        int offset;
+        int scanned; // end of the data exposed to the reader
+        qint64 compressed;
+        qint64 decompressed;
+        qint64 nsecs;
+    } d;
+};
+
+#endif // QUASSELSOCKET_H
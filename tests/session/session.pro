@@ -0,0 +1,15 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = app
+TARGET = tst_session
+CONFIG += testcase console communi
+CONFIG -= app_bundle
+QT = core network testlib
+COMMUNI += core
+
+SOURCES += tst_session.cpp
+OTHER_FILES += server.key server.pem
+
+include(../../quasselprotocol.pri)
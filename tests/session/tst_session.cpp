@@ -0,0 +1,174 @@
+/*
+  Copyright (C) 2013-2014 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Jolla Ltd nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quasselsession.h"
+#include <IrcConnection>
+#include <QtTest/QtTest>
+#include <QSslSocket>
+#include <QTcpServer>
+#include <QProcess>
+
+// Connects twice to a local "openssl s_server" standing in for a core, and
+// checks that the ticket of the first handshake is offered in the second.
+
+class tst_Session : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void resume_data();
+    void resume();
+    void cleanup();
+
+private:
+    bool startServer(const QString& protocol);
+    bool handshake(IrcConnection* connection, QuasselSession* session, bool ticket);
+
+    QString openssl;
+    QProcess server;
+    int port;
+};
+
+void tst_Session::initTestCase()
+{
+#if QT_VERSION < QT_VERSION_CHECK(5, 2, 0) || defined(QT_NO_SSL)
+    QSKIP("session tickets require Qt >= 5.2 with SSL");
+#endif
+    if (!QSslSocket::supportsSsl())
+        QSKIP("no SSL support");
+    openssl = QStandardPaths::findExecutable("openssl");
+    if (openssl.isEmpty())
+        QSKIP("openssl not found");
+}
+
+void tst_Session::resume_data()
+{
+    QTest::addColumn<QString>("protocol");
+    QTest::addColumn<bool>("resumed");
+
+    QTest::newRow("tls1.2") << "-tls1_2" << true;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    QTest::newRow("tls1.3") << "-tls1_3" << false;
+#endif
+}
+
+void tst_Session::resume()
+{
+    QFETCH(QString, protocol);
+    QFETCH(bool, resumed);
+
+    if (!startServer(protocol))
+        QSKIP("cannot start openssl s_server");
+
+    QuasselSession::clearCache();
+
+    IrcConnection connection;
+    connection.setHost("127.0.0.1");
+    connection.setPort(port);
+    connection.setUserName("user");
+    connection.setNickName("nick");
+    connection.setRealName("real");
+
+    // the session follows the socket that becomes secure later on
+    QuasselSession session(&connection);
+    connection.setSecure(true);
+    QSslSocket* socket = qobject_cast<QSslSocket*>(connection.socket());
+    QVERIFY(socket);
+    socket->setPeerVerifyMode(QSslSocket::VerifyNone);
+
+    QVERIFY(handshake(&connection, &session, protocol == "-tls1_3"));
+    QVERIFY(!session.isResumeAttempted());
+    QVERIFY(!session.isResumed());
+    connection.close();
+
+    QVERIFY(handshake(&connection, &session, false));
+    QVERIFY(session.isResumeAttempted());
+    QCOMPARE(session.isResumed(), resumed);
+    QVERIFY(session.handshakeTime() >= 0);
+    connection.close();
+}
+
+void tst_Session::cleanup()
+{
+    server.kill();
+    server.waitForFinished();
+}
+
+bool tst_Session::startServer(const QString& protocol)
+{
+    // a free port, released again for the server to take
+    QTcpServer probe;
+    if (!probe.listen(QHostAddress::LocalHost))
+        return false;
+    port = probe.serverPort();
+    probe.close();
+
+    server.start(openssl, QStringList() << "s_server" << "-quiet" << protocol
+                                        << "-accept" << QString::number(port)
+                                        << "-cert" << QFINDTESTDATA("server.pem")
+                                        << "-key" << QFINDTESTDATA("server.key"));
+    if (!server.waitForStarted())
+        return false;
+
+    for (int i = 0; i < 50; ++i) {
+        QTcpSocket socket;
+        socket.connectToHost(QHostAddress::LocalHost, port);
+        if (socket.waitForConnected(100)) {
+            // s_server expects a handshake on every accepted connection
+            socket.abort();
+            return true;
+        }
+        QTest::qWait(100);
+    }
+    return false;
+}
+
+bool tst_Session::handshake(IrcConnection* connection, QuasselSession* session, bool ticket)
+{
+    QSignalSpy finished(session, SIGNAL(handshakeFinished(qint64,bool)));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    // TLS 1.3 tickets are sent after the handshake
+    QSignalSpy tickets(connection->socket(), SIGNAL(newSessionTicketReceived()));
+#endif
+    connection->open();
+
+    if (!finished.wait(5000))
+        return false;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    if (ticket && tickets.isEmpty() && !tickets.wait(5000))
+        return false;
+#else
+    Q_UNUSED(ticket);
+#endif
+    return true;
+}
+
+QTEST_MAIN(tst_Session)
+
+#include "tst_session.moc"